@@ -0,0 +1,255 @@
+#include <database/cipher.hpp>
+#include <database/database.hpp>
+#include <database/time.hpp>
+#include <database/todo_batch.hpp>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+    // Bumped by the operator new below. SQLite allocates with malloc, so
+    // only what our side allocates per row shows up.
+    std::atomic<std::uint64_t> allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+    constexpr char const* BENCH_KEY = "fachory-bench";
+
+    std::filesystem::path bench_file(std::string const& name) {
+        return std::filesystem::temp_directory_path() / fmt::format("fachory_bench_{}.db", name);
+    }
+
+    void remove_database(std::filesystem::path const& path) {
+        for (auto const* suffix : {"", "-wal", "-shm", "-journal"}) {
+            std::filesystem::remove(path.string() + suffix);
+        }
+    }
+
+    // Pending tasks are added behind the Database's back, it has no API
+    // for that. Goes through the same key, so the file stays encrypted.
+    void insert_pending(std::filesystem::path const& path, std::int64_t first, std::int64_t count) {
+        SQLite::Database db{path.string(), SQLite::OPEN_READWRITE};
+        db.key(BENCH_KEY);
+
+        SQLite::Transaction transaction{db};
+        SQLite::Statement insert{
+            db, "INSERT INTO pending (uuid, name, description, created_at) VALUES (?, ?, ?, ?)"};
+        for (auto id = first; id < first + count; ++id) {
+            insert.bind(1, fmt::format("00000000-0000-4000-8000-{:012}", id));
+            insert.bind(2, fmt::format("Task number {}", id));
+            insert.bind(3, "Pick up the order from the counter and bring it to table four");
+            insert.bind(4, static_cast<std::int64_t>(1389270934000) + id);
+            insert.exec();
+            insert.reset();
+        }
+        transaction.commit();
+    }
+
+    // One migrated and seeded database per row count, shared by every
+    // benchmark in the run and removed at exit
+    class SeededDatabases {
+    public:
+        ~SeededDatabases() {
+            for (auto const& [rows, path] : _paths) {
+                remove_database(path);
+            }
+        }
+
+        std::filesystem::path const& get(std::int64_t rows) {
+            auto found = _paths.find(rows);
+            if (found != end(_paths)) {
+                return found->second;
+            }
+
+            auto path = bench_file(fmt::format("{}_rows", rows));
+            remove_database(path);
+            { fachory::db::Database migrate{path.string(), BENCH_KEY}; }
+            insert_pending(path, 0, rows);
+
+            return _paths.emplace(rows, std::move(path)).first->second;
+        }
+
+    private:
+        std::map<std::int64_t, std::filesystem::path> _paths;
+    };
+
+    std::filesystem::path const& seeded_database(std::int64_t rows) {
+        static SeededDatabases databases;
+        spdlog::set_level(spdlog::level::warn);
+        return databases.get(rows);
+    }
+
+    // Allocations per iteration since first, as the allocs counter
+    void report_allocations(benchmark::State& state, std::uint64_t first) {
+        auto const count         = allocations.load(std::memory_order_relaxed) - first;
+        state.counters["allocs"] = benchmark::Counter{static_cast<double>(count), benchmark::Counter::kAvgIterations};
+    }
+
+    void bench_pending_tasks(benchmark::State& state) {
+        auto const rows = state.range(0);
+        fachory::db::Database db{seeded_database(rows).string(), BENCH_KEY};
+
+        auto const first = allocations.load(std::memory_order_relaxed);
+        for (auto _ : state) {
+            auto tasks = db.pending_tasks();
+            benchmark::DoNotOptimize(tasks.data());
+        }
+
+        report_allocations(state, first);
+        state.SetItemsProcessed(state.iterations() * rows);
+    }
+    BENCHMARK(bench_pending_tasks)->Arg(1'000)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+
+    // The same rows into a reused TodoBatch, against the vector of Todo above
+    void bench_pending_batch(benchmark::State& state) {
+        auto const rows = state.range(0);
+        fachory::db::Database db{seeded_database(rows).string(), BENCH_KEY};
+
+        fachory::db::TodoBatch batch;
+        auto const first = allocations.load(std::memory_order_relaxed);
+        for (auto _ : state) {
+            db.pending_batch(batch);
+            benchmark::DoNotOptimize(batch.size());
+        }
+
+        report_allocations(state, first);
+        state.SetItemsProcessed(state.iterations() * rows);
+    }
+    BENCHMARK(bench_pending_batch)->Arg(1'000)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+
+    // Every task marked done is put back, outside the timing, so the table
+    // keeps its size however many iterations run
+    void bench_mark_task_done(benchmark::State& state) {
+        auto const batch_size = state.range(0);
+        auto const path       = bench_file("mark_done");
+        remove_database(path);
+
+        std::int64_t next_id = 0;
+        {
+            fachory::db::Database db{path.string(), BENCH_KEY};
+            spdlog::set_level(spdlog::level::warn);
+
+            std::vector<std::string> uuids;
+            for (auto _ : state) {
+                state.PauseTiming();
+                insert_pending(path, next_id, batch_size);
+                uuids.clear();
+                for (auto id = next_id; id < next_id + batch_size; ++id) {
+                    uuids.push_back(fmt::format("00000000-0000-4000-8000-{:012}", id));
+                }
+                next_id += batch_size;
+                state.ResumeTiming();
+
+                if (batch_size == 1) {
+                    benchmark::DoNotOptimize(db.mark_task_done(uuids.front()));
+                } else {
+                    benchmark::DoNotOptimize(db.mark_tasks_done(uuids));
+                }
+            }
+        }
+
+        remove_database(path);
+        state.SetItemsProcessed(next_id);
+    }
+    BENCHMARK(bench_mark_task_done)->Arg(1)->Arg(100)->Unit(benchmark::kMicrosecond);
+
+    void bench_parse_time(benchmark::State& state, std::string_view text) {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(fachory::db::parse_time(text));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_CAPTURE(bench_parse_time, iso, std::string_view{"2014-01-09 12:35:34"});
+    BENCHMARK_CAPTURE(bench_parse_time, iso_offset, std::string_view{"2014-01-09T12:35:34.250+02:00"});
+    BENCHMARK_CAPTURE(bench_parse_time, legacy, std::string_view{"Jan 9 2014 12:35:34"});
+
+    // Opening a new file runs every migration and derives a key for its new
+    // salt. Reopening an up to date one reads the schema fingerprint, with
+    // the key derived on the first open of the process.
+    void bench_open_new(benchmark::State& state) {
+        auto const path = bench_file("open_new");
+        spdlog::set_level(spdlog::level::warn);
+
+        for (auto _ : state) {
+            state.PauseTiming();
+            remove_database(path);
+            state.ResumeTiming();
+
+            fachory::db::Database db{path.string(), BENCH_KEY};
+        }
+
+        remove_database(path);
+    }
+    BENCHMARK(bench_open_new)->Unit(benchmark::kMillisecond);
+
+    void bench_open_migrated(benchmark::State& state) {
+        auto const& path = seeded_database(1'000);
+
+        for (auto _ : state) {
+            fachory::db::Database db{path.string(), BENCH_KEY};
+        }
+    }
+    BENCHMARK(bench_open_migrated)->Unit(benchmark::kMillisecond);
+
+    // Every reader is another connection to key
+    void bench_open_concurrent(benchmark::State& state) {
+        auto const& path = seeded_database(1'000);
+        auto const config =
+            fachory::db::DatabaseConfig{.concurrent = true, .readers = static_cast<std::size_t>(state.range(0))};
+
+        for (auto _ : state) {
+            fachory::db::Database db{path.string(), BENCH_KEY, config};
+        }
+    }
+    BENCHMARK(bench_open_concurrent)->Arg(1)->Arg(8)->Unit(benchmark::kMillisecond);
+
+    // A raw key skips the derivation altogether
+    void bench_open_raw_key(benchmark::State& state) {
+        auto const& path = seeded_database(1'000);
+
+        std::ifstream file{path, std::ios::binary};
+        fachory::db::CipherSalt salt{};
+        file.read(reinterpret_cast<char*>(salt.data()), static_cast<std::streamsize>(salt.size()));
+        auto const raw_key = fachory::db::derive_raw_key(BENCH_KEY, salt, {});
+
+        for (auto _ : state) {
+            fachory::db::Database db{path.string(), raw_key};
+        }
+    }
+    BENCHMARK(bench_open_raw_key)->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -0,0 +1,60 @@
+#include <metrics/metrics.hpp>
+#include <metrics/trace.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+namespace {
+
+    namespace metrics = fachory::metrics;
+
+    // What instrumentation costs each event on the hot path
+    void bench_metrics_add(benchmark::State& state) {
+        for (auto _ : state) {
+            metrics::add(metrics::Counter::PrintBytesWritten, 64);
+        }
+    }
+    BENCHMARK(bench_metrics_add)->ThreadRange(1, 8);
+
+    void bench_metrics_record(benchmark::State& state) {
+        auto elapsed = std::chrono::nanoseconds{1};
+        for (auto _ : state) {
+            metrics::record(metrics::Timer::DbQuery, elapsed);
+            elapsed = (elapsed * 7) % std::chrono::seconds{1};
+        }
+    }
+    BENCHMARK(bench_metrics_record)->ThreadRange(1, 8);
+
+    void bench_metrics_scoped_timer(benchmark::State& state) {
+        for (auto _ : state) {
+            metrics::ScopedTimer timer{metrics::Timer::PrintDocumentStart};
+        }
+    }
+    BENCHMARK(bench_metrics_scoped_timer)->ThreadRange(1, 8);
+
+    // One stage of several timed back to back, a clock read less than above
+    void bench_metrics_stage_timer(benchmark::State& state) {
+        metrics::StageTimer stages;
+        for (auto _ : state) {
+            stages.lap(metrics::Timer::PrintDocumentWrite);
+        }
+    }
+    BENCHMARK(bench_metrics_stage_timer)->ThreadRange(1, 8);
+
+    void bench_metrics_stats(benchmark::State& state) {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(metrics::stats());
+        }
+    }
+    BENCHMARK(bench_metrics_stats);
+
+    // Used directly, FACHORY_TRACE_SCOPE is empty unless tracing is built in
+    void bench_trace_span(benchmark::State& state) {
+        for (auto _ : state) {
+            metrics::TraceSpan span{"bench_trace_span"};
+        }
+    }
+    BENCHMARK(bench_trace_span)->ThreadRange(1, 8);
+
+} // namespace
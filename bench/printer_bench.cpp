@@ -0,0 +1,163 @@
+#include <printer/printer_manager.hpp>
+#include <printer/raster.hpp>
+#include <printer/simulated_backend.hpp>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+    constexpr char const* BENCH_PRINTER = "bench";
+
+    // A manager printing to one simulated printer that takes bytes as fast
+    // as they come, so only the work done on our side is measured
+    std::unique_ptr<PrinterManager> simulated_manager(std::size_t cache_budget = PayloadCache::DEFAULT_BUDGET) {
+        spdlog::set_level(spdlog::level::warn);
+
+        auto backend = std::make_shared<SimulatedBackend>();
+        backend->plug_in(BENCH_PRINTER);
+
+        PrinterManagerConfig config;
+        config.backend      = std::move(backend);
+        config.cache_budget = cache_budget;
+
+        auto manager = std::make_unique<PrinterManager>(std::move(config));
+        if (!manager->wait_for_printers(std::chrono::seconds{1})) {
+            spdlog::error("simulated printer was not discovered");
+        }
+
+        return manager;
+    }
+
+    std::filesystem::path write_bench_file(std::size_t size) {
+        auto path = std::filesystem::temp_directory_path() / fmt::format("fachory_bench_{}.pdf", size);
+
+        std::mt19937 random{static_cast<std::uint32_t>(size)};
+        std::vector<char> contents(size);
+        for (auto& byte : contents) {
+            byte = static_cast<char>(random());
+        }
+
+        std::ofstream{path, std::ios::binary}.write(contents.data(), static_cast<std::streamsize>(size));
+        return path;
+    }
+
+    // A smooth gradient with noise on top, closer to a photo than either
+    // would be on its own
+    GrayImage bench_image(std::size_t width, std::size_t height) {
+        GrayImage image{.width = width, .height = height, .pixels = std::vector<std::uint8_t>(width * height)};
+
+        std::mt19937 random{7};
+        std::uniform_int_distribution<int> noise{-24, 24};
+        for (std::size_t y = 0; y < height; ++y) {
+            for (std::size_t x = 0; x < width; ++x) {
+                auto const value              = static_cast<int>((x * 255) / width) + noise(random);
+                image.pixels[(y * width) + x] = static_cast<std::uint8_t>(std::clamp(value, 0, 255));
+            }
+        }
+
+        return image;
+    }
+
+    void bench_print_text(benchmark::State& state) {
+        auto const manager = simulated_manager();
+        std::string const text(static_cast<std::size_t>(state.range(0)), 'x');
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(manager->print_text(BENCH_PRINTER, text));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(bench_print_text)->Arg(64)->Arg(4 * 1024);
+
+    // Second argument 1 lets the payload cache keep the file, 0 streams it
+    // from disk on every print
+    void bench_print_file(benchmark::State& state) {
+        auto const size    = static_cast<std::size_t>(state.range(0));
+        auto const cached  = state.range(1) != 0;
+        auto const manager = simulated_manager(cached ? PayloadCache::DEFAULT_BUDGET : 0);
+        auto const path    = write_bench_file(size);
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(manager->print_pdf(BENCH_PRINTER, path.string()));
+        }
+
+        std::filesystem::remove(path);
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(bench_print_file)->ArgsProduct({{64 * 1024, 4 * 1024 * 1024}, {0, 1}});
+
+    // Jobs per second through a printer's queue and worker, with one batch
+    // of futures in flight at a time
+    void bench_submit(benchmark::State& state) {
+        auto const manager    = simulated_manager();
+        auto const batch_size = static_cast<std::size_t>(state.range(0));
+
+        std::vector<std::future<JobResult>> results;
+        results.reserve(batch_size);
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                results.push_back(
+                    manager->submit(BENCH_PRINTER, PrintPayload{.kind = PayloadKind::Text, .content = "receipt\n"}));
+            }
+
+            for (auto& result : results) {
+                benchmark::DoNotOptimize(result.get());
+            }
+            results.clear();
+        }
+
+        state.counters["jobs"] = benchmark::Counter(
+            static_cast<double>(state.iterations() * batch_size), benchmark::Counter::kIsRate);
+    }
+    BENCHMARK(bench_submit)->Arg(64)->UseRealTime();
+
+    // Throughput in pixels, reported as items (so M/s reads as MP/s)
+    void bench_dither_floyd_steinberg(benchmark::State& state) {
+        auto const image = bench_image(THERMAL_HEAD_WIDTH, static_cast<std::size_t>(state.range(0)));
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(dither_floyd_steinberg(image));
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(image.pixels.size()));
+    }
+    BENCHMARK(bench_dither_floyd_steinberg)->Arg(1024);
+
+    void bench_dither_ordered(benchmark::State& state) {
+        auto const level = static_cast<SimdLevel>(state.range(1));
+        if (level > best_simd_level()) {
+            state.SkipWithError("not supported by this CPU");
+            return;
+        }
+
+        auto const image = bench_image(THERMAL_HEAD_WIDTH, static_cast<std::size_t>(state.range(0)));
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(dither_ordered(image, level));
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(image.pixels.size()));
+    }
+    BENCHMARK(bench_dither_ordered)
+        ->ArgsProduct({{1024},
+            {static_cast<std::int64_t>(SimdLevel::Scalar), static_cast<std::int64_t>(SimdLevel::Sse),
+             static_cast<std::int64_t>(SimdLevel::Avx2)}});
+
+} // namespace
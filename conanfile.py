@@ -6,13 +6,18 @@ class WavyTuneConan(ConanFile):
     generators = "CMakeDeps", "CMakeToolchain"
 
     def requirements(self):
+        self.requires("benchmark/1.9.1")
         self.requires("cxxopts/3.2.0")
         self.requires("fmt/11.2.0")
         self.requires("gtest/1.16.0")
+        self.requires("libjpeg-turbo/3.0.4")
         self.requires("ms-gsl/4.1.0")
+        self.requires("openssl/[>=3 <4]")
         self.requires("qt/6.5.3")
         self.requires("spdlog/1.15.3")
         self.requires("sqlitecpp/3.3.3")
 
     def configure(self):
         self.options["sqlitecpp/*"].with_sqlcipher = True
+        # The task search index is an FTS5 table, Database checks for it on open
+        self.options["sqlcipher/*"].enable_fts = True
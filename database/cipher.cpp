@@ -0,0 +1,125 @@
+#include <database/cipher.hpp>
+
+#include <database/database.hpp>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <tuple>
+
+namespace {
+
+    using fachory::db::CIPHER_KEY_BYTES;
+    using fachory::db::CIPHER_SALT_BYTES;
+    using fachory::db::CipherSalt;
+
+    EVP_MD const* kdf_digest(std::string_view algorithm) {
+        if (algorithm == "PBKDF2_HMAC_SHA512") {
+            return EVP_sha512();
+        }
+        if (algorithm == "PBKDF2_HMAC_SHA256") {
+            return EVP_sha256();
+        }
+        if (algorithm == "PBKDF2_HMAC_SHA1") {
+            return EVP_sha1();
+        }
+
+        throw fachory::db::DatabaseException{fmt::format("unknown kdf algorithm {}", algorithm)};
+    }
+
+    // SQLCipher keeps the salt in the first bytes of the file, nullopt for
+    // a file that doesn't exist or has nothing written yet
+    std::optional<CipherSalt> stored_salt(std::string const& db_file) {
+        std::ifstream file{db_file, std::ios::binary};
+        CipherSalt salt;
+        if (!file.read(reinterpret_cast<char*>(salt.data()), salt.size())) {
+            return std::nullopt;
+        }
+
+        return salt;
+    }
+
+    CipherSalt new_salt() {
+        CipherSalt salt;
+        if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1) {
+            throw fachory::db::DatabaseException{"could not generate a database salt"};
+        }
+
+        return salt;
+    }
+
+    // Derived keys are as secret as the passphrases, and stay in memory for
+    // as long as SQLCipher keeps them in every open connection anyway
+    class DerivedKeys {
+    public:
+        std::string get(std::string_view passphrase, CipherSalt const& salt, fachory::db::CipherConfig const& cipher) {
+            auto id = std::make_tuple(std::string{passphrase}, salt, cipher.kdf_iter, cipher.kdf_algorithm);
+
+            // Held while deriving, so connections racing to open the same
+            // file wait for one derivation instead of each running their own
+            std::scoped_lock lock{_mutex};
+            auto found = _keys.find(id);
+            if (found == end(_keys)) {
+                found = _keys.emplace(std::move(id), fachory::db::derive_raw_key(passphrase, salt, cipher)).first;
+            }
+
+            return found->second;
+        }
+
+    private:
+        using Id = std::tuple<std::string, CipherSalt, std::int64_t, std::string>;
+
+        std::mutex _mutex;
+        std::map<Id, std::string> _keys;
+    };
+
+} // namespace
+
+namespace fachory::db {
+
+    bool is_raw_key(std::string_view key) {
+        if (key.size() < 3 || (key[0] != 'x' && key[0] != 'X') || key[1] != '\'' || key.back() != '\'') {
+            return false;
+        }
+
+        auto const hex = key.substr(2, key.size() - 3);
+        if (hex.size() != CIPHER_KEY_BYTES * 2 && hex.size() != (CIPHER_KEY_BYTES + CIPHER_SALT_BYTES) * 2) {
+            return false;
+        }
+
+        return std::ranges::all_of(hex, [](unsigned char c) { return std::isxdigit(c) != 0; });
+    }
+
+    std::string derive_raw_key(std::string_view passphrase, CipherSalt const& salt, CipherConfig const& cipher) {
+        std::array<unsigned char, CIPHER_KEY_BYTES> key;
+        auto const derived = PKCS5_PBKDF2_HMAC(passphrase.data(), static_cast<int>(passphrase.size()), salt.data(),
+            static_cast<int>(salt.size()), static_cast<int>(cipher.kdf_iter), kdf_digest(cipher.kdf_algorithm),
+            static_cast<int>(key.size()), key.data());
+        if (derived != 1) {
+            throw DatabaseException{"could not derive the database key"};
+        }
+
+        // With the salt appended, SQLCipher also uses it for a new file
+        return fmt::format("x'{:02x}{:02x}'", fmt::join(key, ""), fmt::join(salt, ""));
+    }
+
+    std::string connection_key(std::string const& db_file, std::string const& db_key, CipherConfig const& cipher) {
+        // An empty key leaves the file unencrypted
+        if (db_key.empty() || is_raw_key(db_key)) {
+            return db_key;
+        }
+
+        static DerivedKeys derived_keys;
+
+        auto const salt = stored_salt(db_file);
+        return derived_keys.get(db_key, salt ? *salt : new_salt(), cipher);
+    }
+} // namespace fachory::db
@@ -1,36 +1,120 @@
 #include <database/database.hpp>
 
+#include <database/time.hpp>
+#include <metrics/metrics.hpp>
+#include <metrics/trace.hpp>
+
 #include <SQLiteCpp/Database.h>
 #include <SQLiteCpp/Exception.h>
 #include <SQLiteCpp/Statement.h>
+#include <SQLiteCpp/Transaction.h>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
+#include <sqlite3.h>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <span>
-#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 namespace {
 
     static auto constexpr MIGRATION_TABLE_CREATION_STATEMENT =
-        R"(CREATE TABLE migrations (id INTEGER AUTO INCREMENT PRIMARY KEY, uuid TEXT, applied_at DATETIME);)";
+        R"(CREATE TABLE IF NOT EXISTS migrations (id INTEGER AUTO INCREMENT PRIMARY KEY, uuid TEXT, applied_at DATETIME);)";
+
+    // Key/value settings about the schema itself, such as the fingerprint
+    // of the migrations it was brought up to date with
+    static auto constexpr SCHEMA_META_TABLE_CREATION_STATEMENT =
+        R"(CREATE TABLE IF NOT EXISTS schema_meta (key TEXT PRIMARY KEY, value TEXT NOT NULL);)";
 
     // Migrations are in the form (uuidv4, migration statement)
-    static std::array<std::pair<const char*, const char*>, 2> constexpr MIGRATIONS{{
+    // A migration may hold several statements, they are run with exec
+    static std::array<std::pair<const char*, const char*>, 6> constexpr MIGRATIONS{{
      {"7b87b3ab-6153-4904-9270-73b61efe637c", R"(CREATE TABLE pending (id INTEGER AUTO INCREMENT PRIMARY KEY);)"},
      {"98739ef0-69eb-4196-a884-b5b18b0e93e7",
       R"(CREATE TABLE completed (id INTEGER AUTO INCREMENT PRIMARY KEY, uuid TEXT, name TEXT, description TEXT, comments TEXT, date DATETIME, completed_at DATETIME);)"},
+     // The first pending table only had an id, which wasn't even a rowid
+     // alias. It is replaced by one that holds the task, keyed by rowid.
+     {"3f0c7c52-8e4b-4d0e-9a57-1c2f61d5b8a4",
+      R"(DROP TABLE pending;
+         CREATE TABLE pending (id INTEGER PRIMARY KEY, uuid TEXT NOT NULL UNIQUE, name TEXT NOT NULL DEFAULT '', description TEXT NOT NULL DEFAULT '', date DATETIME);)"},
+     // Timestamps become INTEGER milliseconds since the epoch. Text SQLite
+     // can't read as a date is kept as is, parse_time handles it on read.
+     {"c5e2a8d1-4b7f-4f63-8d0a-2e9b6a1f7c34",
+      R"(CREATE TABLE pending_next (id INTEGER PRIMARY KEY, uuid TEXT NOT NULL UNIQUE, name TEXT NOT NULL DEFAULT '', description TEXT NOT NULL DEFAULT '', created_at INTEGER);
+         INSERT INTO pending_next (id, uuid, name, description, created_at)
+             SELECT id, uuid, name, description, COALESCE(CAST(ROUND((julianday(date) - 2440587.5) * 86400000) AS INTEGER), date) FROM pending;
+         DROP TABLE pending;
+         ALTER TABLE pending_next RENAME TO pending;
+         CREATE TABLE completed_next (id INTEGER PRIMARY KEY, uuid TEXT, name TEXT, description TEXT, comments TEXT, created_at INTEGER, completed_at INTEGER);
+         INSERT INTO completed_next (uuid, name, description, comments, created_at, completed_at)
+             SELECT uuid, name, description, comments,
+                 COALESCE(CAST(ROUND((julianday(date) - 2440587.5) * 86400000) AS INTEGER), date),
+                 COALESCE(CAST(ROUND((julianday(completed_at) - 2440587.5) * 86400000) AS INTEGER), completed_at)
+             FROM completed;
+         DROP TABLE completed;
+         ALTER TABLE completed_next RENAME TO completed;)"},
+     // Full-text index over both tables. Pending rows are indexed under
+     // rowid 2 * id and completed ones under 2 * id + 1, so the triggers
+     // find their entry by rowid rather than scanning for the uuid.
+     {"e81d4f27-96b3-4c1a-b0f5-7a3d2c9e6b18",
+      R"(CREATE VIRTUAL TABLE todo_search USING fts5(name, description, uuid UNINDEXED, tokenize = 'unicode61 remove_diacritics 2');
+         INSERT INTO todo_search (rowid, name, description, uuid) SELECT id * 2, name, description, uuid FROM pending;
+         INSERT INTO todo_search (rowid, name, description, uuid) SELECT id * 2 + 1, name, description, uuid FROM completed;
+         CREATE TRIGGER pending_search_insert AFTER INSERT ON pending BEGIN
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2, new.name, new.description, new.uuid);
+         END;
+         CREATE TRIGGER pending_search_delete AFTER DELETE ON pending BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2;
+         END;
+         CREATE TRIGGER pending_search_update AFTER UPDATE ON pending BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2;
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2, new.name, new.description, new.uuid);
+         END;
+         CREATE TRIGGER completed_search_insert AFTER INSERT ON completed BEGIN
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2 + 1, new.name, new.description, new.uuid);
+         END;
+         CREATE TRIGGER completed_search_delete AFTER DELETE ON completed BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2 + 1;
+         END;
+         CREATE TRIGGER completed_search_update AFTER UPDATE ON completed BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2 + 1;
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2 + 1, new.name, new.description, new.uuid);
+         END;)"},
+     // A plain rowid alias hands the id of the newest task out again once
+     // it is done, and readers paging by id would skip the new task. The
+     // index entries keep their rowids, only the triggers go with the table.
+     {"5d7a0c3e-2f19-4b86-a4e1-93c6b8f0d257",
+      R"(CREATE TABLE pending_next (id INTEGER PRIMARY KEY AUTOINCREMENT, uuid TEXT NOT NULL UNIQUE, name TEXT NOT NULL DEFAULT '', description TEXT NOT NULL DEFAULT '', created_at INTEGER);
+         INSERT INTO pending_next (id, uuid, name, description, created_at) SELECT id, uuid, name, description, created_at FROM pending;
+         DROP TABLE pending;
+         ALTER TABLE pending_next RENAME TO pending;
+         CREATE TRIGGER pending_search_insert AFTER INSERT ON pending BEGIN
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2, new.name, new.description, new.uuid);
+         END;
+         CREATE TRIGGER pending_search_delete AFTER DELETE ON pending BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2;
+         END;
+         CREATE TRIGGER pending_search_update AFTER UPDATE ON pending BEGIN
+             DELETE FROM todo_search WHERE rowid = old.id * 2;
+             INSERT INTO todo_search (rowid, name, description, uuid) VALUES (new.id * 2, new.name, new.description, new.uuid);
+         END;)"},
     }};
 
-    fachory::db::Time str_to_time(std::string const& date) {
-        std::tm tm = {};
-        std::stringstream ss("Jan 9 2014 12:35:34");
-        ss >> std::get_time(&tm, "%b %d %Y %H:%M:%S");
-
-        return std::chrono::system_clock::from_time_t(std::mktime(&tm));
-    }
-
     bool check_db_connection(SQLite::Database& db) {
         try {
             SQLite::Statement query(db, "SELECT 1");
@@ -40,104 +124,747 @@ namespace {
         }
     }
 
-    bool migrate_db(SQLite::Database& db, std::span<std::pair<const char*, const char*> const> migrations) {
-        // Check if the metadata table exists
-        if (!db.tableExists("migrations")) {
-            auto const ret = db.exec(MIGRATION_TABLE_CREATION_STATEMENT);
-            if (ret != SQLite::OK) {
-                return false;
+    using Migration = std::pair<const char*, const char*>;
+
+    // FNV-1a over every migration and the cipher settings, changes whenever
+    // a migration is added or edited or the database is opened differently
+    std::string schema_fingerprint(std::span<Migration const> migrations, fachory::db::CipherConfig const& cipher) {
+        constexpr std::uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+        constexpr std::uint64_t FNV_PRIME  = 0x100000001b3ULL;
+
+        auto hash     = FNV_OFFSET;
+        auto add_text = [&hash](std::string_view text) {
+            for (auto const c : text) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
             }
-        }
+            // Separator, so moving text between fields changes the hash
+            hash = (hash ^ 0xFF) * FNV_PRIME;
+        };
 
-        SQLite::Statement check_statement{db, "SELECT (id) FROM migrations WHERE uuid = ?;"};
         for (auto const& [uuid, statement] : migrations) {
+            add_text(uuid);
+            add_text(statement);
+        }
+
+        add_text(std::to_string(cipher.kdf_iter));
+        add_text(std::to_string(cipher.page_size));
+        add_text(cipher.kdf_algorithm);
+        add_text(cipher.hmac_algorithm);
+
+        return fmt::format("{:016x}", hash);
+    }
+
+    // nullopt when there is nothing stored, or the table isn't there yet
+    std::optional<std::string> stored_fingerprint(SQLite::Database& db) {
+        try {
+            SQLite::Statement query{db, "SELECT value FROM schema_meta WHERE key = 'fingerprint'"};
+            if (!query.executeStep()) {
+                return std::nullopt;
+            }
 
-            // Check the migrations exists
-            check_statement.bind(1, uuid);
-            auto const check_res = check_statement.executeStep();
-            check_statement.reset();
+            return query.getColumn(0).getString();
+        } catch (SQLite::Exception const&) {
+            return std::nullopt;
+        }
+    }
 
-            if (check_res) {
-                spdlog::warn("migration {} has already been applied, skipping", uuid);
-                continue;
+    // The settings can't be read from the file before it is decrypted, they
+    // are recorded so the file says how to open it. A raw key opens the file
+    // whatever the kdf settings, so those may differ from what was recorded.
+    void record_cipher(SQLite::Database& db, fachory::db::CipherConfig const& cipher) {
+        std::array<std::pair<char const*, std::string>, 4> const settings{{
+         {"cipher_kdf_iter", std::to_string(cipher.kdf_iter)},
+         {"cipher_page_size", std::to_string(cipher.page_size)},
+         {"cipher_kdf_algorithm", cipher.kdf_algorithm},
+         {"cipher_hmac_algorithm", cipher.hmac_algorithm},
+        }};
+
+        SQLite::Statement stored{db, "SELECT value FROM schema_meta WHERE key = ?"};
+        SQLite::Statement record{db, "INSERT INTO schema_meta(key, value) values(?, ?)"};
+        for (auto const& [key, value] : settings) {
+            stored.bind(1, key);
+            if (!stored.executeStep()) {
+                record.bind(1, key);
+                record.bind(2, value);
+                record.exec();
+                record.reset();
+            } else if (auto const recorded = stored.getColumn(0).getString(); recorded != value) {
+                spdlog::warn("database was created with {} = {}, opened with {}", key, recorded, value);
             }
+            stored.reset();
+        }
+    }
 
-            // apply the migration
-            spdlog::info("appying migration {}", uuid);
-            try {
-                SQLite::Statement migration_statement{db, statement};
-                migration_statement.executeStep();
+    // Applies the migrations missing from the migrations table and records
+    // them, with the cipher settings and the new fingerprint, in a single
+    // transaction
+    bool migrate_db(SQLite::Database& db, std::span<Migration const> migrations,
+        fachory::db::CipherConfig const& cipher, std::string const& fingerprint) {
+        try {
+            SQLite::Transaction transaction{db, SQLite::TransactionBehavior::IMMEDIATE};
+            db.exec(MIGRATION_TABLE_CREATION_STATEMENT);
+            db.exec(SCHEMA_META_TABLE_CREATION_STATEMENT);
+
+            std::set<std::string, std::less<>> applied;
+            {
+                SQLite::Statement applied_statement{db, "SELECT uuid FROM migrations WHERE uuid IS NOT NULL"};
+                while (applied_statement.executeStep()) {
+                    applied.insert(applied_statement.getColumn(0).getString());
+                }
+            }
 
-                SQLite::Statement migration_uuid_statement{
-                 db, "INSERT INTO migrations(uuid, applied_at) values(?, DATE('now'))"};
-                migration_uuid_statement.executeStep();
-            } catch (SQLite::Exception const& e) {
-                spdlog::error("error applying migration {}: {}", uuid, e.what());
-                return false;
+            SQLite::Statement record_statement{db, "INSERT INTO migrations(uuid, applied_at) values(?, DATE('now'))"};
+            for (auto const& [uuid, statement] : migrations) {
+                if (applied.contains(std::string_view{uuid})) {
+                    continue;
+                }
+
+                spdlog::info("applying migration {}", uuid);
+                db.exec(statement);
+
+                record_statement.bind(1, uuid);
+                record_statement.exec();
+                record_statement.reset();
             }
+
+            record_cipher(db, cipher);
+
+            SQLite::Statement fingerprint_statement{
+             db, "INSERT OR REPLACE INTO schema_meta(key, value) values('fingerprint', ?)"};
+            fingerprint_statement.bind(1, fingerprint);
+            fingerprint_statement.exec();
+
+            transaction.commit();
+        } catch (SQLite::Exception const& e) {
+            spdlog::error("error applying migrations: {}", e.what());
+            return false;
         }
 
         return true;
     }
+
+    // A statement out of a connection's cache, reset for its next user when
+    // this goes away so it never holds a read transaction open
+    class CachedStatement {
+    public:
+        explicit CachedStatement(SQLite::Statement& statement)
+            : _statement{&statement} {}
+
+        ~CachedStatement() {
+            _statement->tryReset();
+        }
+
+        CachedStatement(CachedStatement const&)            = delete;
+        CachedStatement& operator=(CachedStatement const&) = delete;
+
+        SQLite::Statement* operator->() const {
+            return _statement;
+        }
+
+    private:
+        SQLite::Statement* _statement;
+    };
+
+    // Has to come before anything reads the file, SQLCipher decrypts the
+    // first page with these
+    void apply_key(SQLite::Database& db, std::string const& key, fachory::db::CipherConfig const& cipher) {
+        db.key(key);
+        if (key.empty()) {
+            return;
+        }
+
+        db.exec(fmt::format("PRAGMA cipher_page_size = {}", cipher.page_size));
+        db.exec(fmt::format("PRAGMA cipher_hmac_algorithm = {}", cipher.hmac_algorithm));
+        db.exec(fmt::format("PRAGMA cipher_kdf_algorithm = {}", cipher.kdf_algorithm));
+        db.exec(fmt::format("PRAGMA kdf_iter = {}", cipher.kdf_iter));
+    }
+
+    void apply_pragmas(SQLite::Database& db, fachory::db::DatabaseConfig const& config) {
+        db.setBusyTimeout(static_cast<int>(config.busy_timeout.count()));
+        db.exec(fmt::format("PRAGMA synchronous = {}", config.synchronous));
+        db.exec(fmt::format("PRAGMA mmap_size = {}", config.mmap_size));
+
+        // Negative sizes are in KiB rather than pages
+        db.exec(fmt::format("PRAGMA cache_size = -{}", config.cache_size_kib));
+    }
+
+    // Each word of the user's query as a quoted FTS5 string, so operators
+    // and punctuation in it are searched for rather than parsed
+    std::string to_match_expression(std::string_view query) {
+        std::string expression;
+        expression.reserve(query.size() + 8);
+
+        std::size_t position = 0;
+        while (position < query.size()) {
+            auto const start = query.find_first_not_of(" \t\n", position);
+            if (start == std::string_view::npos) {
+                break;
+            }
+
+            auto end = query.find_first_of(" \t\n", start);
+            if (end == std::string_view::npos) {
+                end = query.size();
+            }
+
+            if (!expression.empty()) {
+                expression += ' ';
+            }
+
+            expression += '"';
+            for (auto const c : query.substr(start, end - start)) {
+                expression += c;
+                if (c == '"') {
+                    expression += '"';
+                }
+            }
+            expression += '"';
+
+            position = end;
+        }
+
+        // Prefix match on the last word
+        if (!expression.empty()) {
+            expression += '*';
+        }
+
+        return expression;
+    }
+
+    std::string_view column_text(SQLite::Column const& column) {
+        // getText before getBytes, so the size is the size of the text
+        auto const* text = column.getText();
+        return std::string_view{text, static_cast<std::size_t>(column.getBytes())};
+    }
+
+    fachory::db::Time column_time(SQLite::Column const& column) {
+        if (column.isInteger()) {
+            return fachory::db::from_epoch_ms(column.getInt64());
+        }
+
+        // Rows the timestamp migration couldn't convert
+        if (column.isText()) {
+            auto const text = column_text(column);
+            if (auto const time = fachory::db::parse_time(text)) {
+                return *time;
+            }
+
+            spdlog::warn("could not parse timestamp {}", text);
+        }
+
+        return fachory::db::Time{};
+    }
 } // namespace
 
 namespace fachory::db {
 
+    struct Database::Connection {
+        Connection(std::string const& db_file, int flags)
+            : db{db_file, flags}, statements{} {}
+
+        // Prepared on first use, then reused for the lifetime of the connection
+        CachedStatement prepare(std::string_view sql) {
+            auto found = statements.find(sql);
+            if (found == end(statements)) {
+                auto statement = std::make_unique<SQLite::Statement>(db, std::string{sql});
+                found          = statements.emplace(std::string{sql}, std::move(statement)).first;
+            }
+
+            return CachedStatement{*found->second};
+        }
+
+        SQLite::Database db;
+        std::map<std::string, std::unique_ptr<SQLite::Statement>, std::less<>> statements;
+    };
+
+    // Row changes reported by SQLite's hooks on the writer connection. They
+    // are staged as statements run, kept once their transaction commits and
+    // handed to subscribers, net per row, when the committing call is done.
+    struct Database::ChangeFeed {
+        // Only these tables are reported, the others are bookkeeping
+        static constexpr std::array<std::string_view, 2> TABLES{"pending", "completed"};
+
+        void attach(SQLite::Database& db) {
+            auto* handle = db.getHandle();
+            sqlite3_update_hook(handle, &ChangeFeed::on_update, this);
+            sqlite3_commit_hook(handle, &ChangeFeed::on_commit, this);
+            sqlite3_rollback_hook(handle, &ChangeFeed::on_rollback, this);
+        }
+
+        void detach(SQLite::Database& db) {
+            auto* handle = db.getHandle();
+            sqlite3_update_hook(handle, nullptr, nullptr);
+            sqlite3_commit_hook(handle, nullptr, nullptr);
+            sqlite3_rollback_hook(handle, nullptr, nullptr);
+        }
+
+        static void on_update(
+            void* feed, int operation, char const* /*database*/, char const* table, sqlite3_int64 row_id) {
+            auto const found = std::find(begin(TABLES), end(TABLES), std::string_view{table});
+            if (found == end(TABLES)) {
+                return;
+            }
+
+            auto const kind = operation == SQLITE_INSERT   ? ChangeKind::Inserted
+                            : operation == SQLITE_DELETE ? ChangeKind::Deleted
+                                                         : ChangeKind::Updated;
+            static_cast<ChangeFeed*>(feed)->staged.push_back(
+                RowChange{.table = *found, .kind = kind, .row_id = row_id});
+        }
+
+        static int on_commit(void* feed) {
+            auto* self = static_cast<ChangeFeed*>(feed);
+            self->committed.insert(end(self->committed), begin(self->staged), end(self->staged));
+            self->staged.clear();
+
+            // Non-zero would turn the commit into a rollback
+            return 0;
+        }
+
+        static void on_rollback(void* feed) {
+            static_cast<ChangeFeed*>(feed)->staged.clear();
+        }
+
+        // Called outside of any SQLite call, subscribers may read
+        void publish() {
+            if (committed.empty()) {
+                return;
+            }
+
+            // Net effect per row, in table and row id order
+            std::map<std::pair<std::string_view, std::int64_t>, ChangeKind> net;
+            for (auto const& change : committed) {
+                auto const key   = std::make_pair(change.table, change.row_id);
+                auto const found = net.find(key);
+                if (found == end(net)) {
+                    net.emplace(key, change.kind);
+                    continue;
+                }
+
+                auto& kind = found->second;
+                if (change.kind == ChangeKind::Deleted) {
+                    if (kind == ChangeKind::Inserted) {
+                        net.erase(found);
+                    } else {
+                        kind = ChangeKind::Deleted;
+                    }
+                } else if (change.kind == ChangeKind::Inserted) {
+                    // A rowid deleted and used again
+                    kind = ChangeKind::Updated;
+                }
+            }
+            committed.clear();
+
+            std::vector<RowChange> changes;
+            changes.reserve(net.size());
+            for (auto const& [key, kind] : net) {
+                changes.push_back(RowChange{.table = key.first, .kind = kind, .row_id = key.second});
+            }
+
+            std::vector<ChangeCallback> callbacks;
+            {
+                std::scoped_lock lock{subscribers_mutex};
+                if (changes.empty() || subscribers.empty()) {
+                    return;
+                }
+
+                callbacks.reserve(subscribers.size());
+                for (auto const& [id, callback] : subscribers) {
+                    callbacks.push_back(callback);
+                }
+            }
+
+            for (auto const& callback : callbacks) {
+                try {
+                    callback(changes);
+                } catch (std::exception const& e) {
+                    spdlog::error("change subscriber threw: {}", e.what());
+                }
+            }
+        }
+
+        // Only touched by the thread using the writer connection
+        std::vector<RowChange> staged;
+        std::vector<RowChange> committed;
+
+        std::mutex subscribers_mutex;
+        std::map<SubscriptionId, ChangeCallback> subscribers;
+        SubscriptionId next_id = 1;
+    };
+
+    // Idle read-only connections, lent out to one caller at a time, and the
+    // thread that owns the writer connection. Writes queued while the writer
+    // is busy are committed together.
+    struct Database::Engine {
+        struct Write {
+            std::function<void(Connection&)> run;
+            std::promise<void> done;
+        };
+
+        Engine(Connection& writer, ChangeFeed& changes, std::vector<std::unique_ptr<Connection>> readers)
+            : writer{writer}, changes{changes}, idle_readers{std::move(readers)}, writes{},
+              writer_thread{[this](std::stop_token stop) { write_loop(std::move(stop)); }} {}
+
+        std::unique_ptr<Connection> acquire_reader() {
+            std::unique_lock lock{readers_mutex};
+            reader_returned.wait(lock, [this] { return !idle_readers.empty(); });
+
+            auto reader = std::move(idle_readers.back());
+            idle_readers.pop_back();
+            return reader;
+        }
+
+        void release_reader(std::unique_ptr<Connection> reader) {
+            {
+                std::scoped_lock lock{readers_mutex};
+                idle_readers.push_back(std::move(reader));
+            }
+            reader_returned.notify_one();
+        }
+
+        void write(std::function<void(Connection&)> run) {
+            std::promise<void> done;
+            auto future = done.get_future();
+            {
+                std::scoped_lock lock{writes_mutex};
+                writes.push_back(Write{.run = std::move(run), .done = std::move(done)});
+            }
+            write_queued.notify_one();
+
+            future.get();
+        }
+
+        void write_loop(std::stop_token stop) {
+            std::vector<Write> group;
+            for (;;) {
+                {
+                    // Whatever is queued on stop is still written
+                    std::unique_lock lock{writes_mutex};
+                    write_queued.wait(lock, stop, [this] { return !writes.empty(); });
+                    if (writes.empty()) {
+                        return;
+                    }
+                    group.swap(writes);
+                }
+
+                commit_group(group);
+                group.clear();
+            }
+        }
+
+        // One transaction for the group, each write in a savepoint so a
+        // failing write is undone without undoing the others
+        void commit_group(std::vector<Write>& group) {
+            FACHORY_TRACE_SCOPE("db_commit_group");
+            std::vector<std::exception_ptr> errors(group.size());
+            try {
+                SQLite::Transaction transaction{writer.db, SQLite::TransactionBehavior::IMMEDIATE};
+                for (std::size_t i = 0; i < group.size(); ++i) {
+                    // Rolling back to a savepoint doesn't call the rollback hook
+                    auto const staged = changes.staged.size();
+
+                    writer.db.exec("SAVEPOINT grouped_write");
+                    try {
+                        group[i].run(writer);
+                        writer.db.exec("RELEASE grouped_write");
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                        writer.db.exec("ROLLBACK TO grouped_write");
+                        writer.db.exec("RELEASE grouped_write");
+                        changes.staged.resize(staged);
+                    }
+                }
+
+                metrics::timed(metrics::Timer::DbCommit, [&transaction] { transaction.commit(); });
+            } catch (...) {
+                // Nothing in the group was committed
+                auto const error = std::current_exception();
+                for (auto& write_error : errors) {
+                    if (!write_error) {
+                        write_error = error;
+                    }
+                }
+            }
+
+            changes.publish();
+
+            for (std::size_t i = 0; i < group.size(); ++i) {
+                if (errors[i]) {
+                    group[i].done.set_exception(errors[i]);
+                } else {
+                    group[i].done.set_value();
+                }
+            }
+        }
+
+        Connection& writer;
+        ChangeFeed& changes;
+
+        std::mutex readers_mutex;
+        std::condition_variable reader_returned;
+        std::vector<std::unique_ptr<Connection>> idle_readers;
+
+        std::mutex writes_mutex;
+        std::condition_variable_any write_queued;
+        std::vector<Write> writes;
+
+        std::jthread writer_thread;
+    };
+
     DatabaseException::DatabaseException(std::string const& message)
         : std::runtime_error(message) {}
 
 
-    Database::Database(std::string const& db_file, std::string const& db_key)
-        : _db{std::make_unique<SQLite::Database>(db_file, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)} {
-        _db->key(db_key);
+    Database::Database(std::string const& db_file, std::string const& db_key, DatabaseConfig const& config)
+        : _connection{std::make_unique<Connection>(db_file, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)},
+          _changes{std::make_unique<ChangeFeed>()}, _engine{} {
+        // Asked of the library rather than the file, so it costs no query.
+        // Without it the search migration fails with "no such module".
+        if (sqlite3_compileoption_used("ENABLE_FTS5") == 0) {
+            throw DatabaseException{"SQLite was built without FTS5, which the task search index needs"};
+        }
 
-        if (!check_db_connection(*_db)) {
-            throw new DatabaseException{fmt::format("could not create the database from file {}", db_file)};
+        // Derived once here, readers opened below reuse it
+        auto const key = connection_key(db_file, db_key, config.cipher);
+        apply_key(_connection->db, key, config.cipher);
+
+        // An up to date database, opened with the cipher settings it was
+        // last opened with, costs this one read at startup. It also proves
+        // the connection works, otherwise that is checked on its own.
+        auto const fingerprint = schema_fingerprint(MIGRATIONS, config.cipher);
+        auto const stored      = stored_fingerprint(_connection->db);
+        if (!stored && !check_db_connection(_connection->db)) {
+            throw DatabaseException{fmt::format("could not create the database from file {}", db_file)};
         }
 
-        if (!migrate_db(*_db, MIGRATIONS)) {
-            throw new DatabaseException{"could not apply database migrations"};
+        if (config.concurrent) {
+            // Persistent, readers opened from here on find the file in WAL mode
+            _connection->db.exec("PRAGMA journal_mode = WAL");
+            apply_pragmas(_connection->db, config);
         }
+
+        if (stored != fingerprint && !migrate_db(_connection->db, MIGRATIONS, config.cipher, fingerprint)) {
+            throw DatabaseException{"could not apply database migrations"};
+        }
+
+        _changes->attach(_connection->db);
+
+        if (!config.concurrent) {
+            return;
+        }
+
+        auto const reader_count =
+            config.readers != 0 ? config.readers : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+        std::vector<std::unique_ptr<Connection>> readers;
+        readers.reserve(reader_count);
+        for (std::size_t i = 0; i < reader_count; ++i) {
+            auto reader = std::make_unique<Connection>(db_file, SQLite::OPEN_READONLY);
+            apply_key(reader->db, key, config.cipher);
+            apply_pragmas(reader->db, config);
+            readers.push_back(std::move(reader));
+        }
+
+        spdlog::info("opened {} in WAL mode with {} readers", db_file, reader_count);
+        _engine = std::make_unique<Engine>(*_connection, *_changes, std::move(readers));
     }
 
-    Database::~Database() {}
+    Database::~Database() {
+        // Writes still queued are done, and published, before the hooks go
+        _engine.reset();
+        _changes->detach(_connection->db);
+    }
 
-    std::vector<Todo> Database::pending_tasks() {
+    void Database::with_reader(std::function<void(Connection&)> const& read) {
+        // Includes waiting for a reader, which is part of what callers see
+        FACHORY_TRACE_SCOPE("db_query");
+        metrics::ScopedTimer timer{metrics::Timer::DbQuery};
 
-        SQLite::Statement query(*_db, "SELECT (id, uuid, name, description, date) FROM pending");
+        if (!_engine) {
+            read(*_connection);
+            return;
+        }
+
+        auto reader = _engine->acquire_reader();
+        try {
+            read(*reader);
+        } catch (...) {
+            _engine->release_reader(std::move(reader));
+            throw;
+        }
+        _engine->release_reader(std::move(reader));
+    }
+
+    void Database::with_writer(std::function<void(Connection&)> write) {
+        FACHORY_TRACE_SCOPE("db_write");
+        if (_engine) {
+            _engine->write(std::move(write));
+            return;
+        }
+
+        {
+            SQLite::Transaction transaction{_connection->db, SQLite::TransactionBehavior::IMMEDIATE};
+            write(*_connection);
+            metrics::timed(metrics::Timer::DbCommit, [&transaction] { transaction.commit(); });
+        }
+
+        _changes->publish();
+    }
 
+    SubscriptionId Database::subscribe(ChangeCallback callback) {
+        std::scoped_lock lock{_changes->subscribers_mutex};
+        auto const id = _changes->next_id++;
+        _changes->subscribers.emplace(id, std::move(callback));
+        return id;
+    }
+
+    void Database::unsubscribe(SubscriptionId id) {
+        std::scoped_lock lock{_changes->subscribers_mutex};
+        _changes->subscribers.erase(id);
+    }
+
+    std::vector<Todo> Database::pending_tasks() {
         std::vector<Todo> all_tasks;
 
-        while (query.executeStep()) {
+        for_each_pending([&all_tasks](TodoRow const& row) {
+            all_tasks.push_back(Todo{.id = std::string{row.id},
+             .name                       = std::string{row.name},
+             .description                = std::string{row.description},
+             .created_at                 = row.created_at});
+        });
 
-            int const id                  = query.getColumn(0);
-            std::string const uuid        = query.getColumn(1);
-            std::string const name        = query.getColumn(2);
-            std::string const description = query.getColumn(3);
-            std::string const date        = query.getColumn(4);
+        return all_tasks;
+    }
+
+    TodoBatch Database::pending_batch() {
+        TodoBatch batch;
+        pending_batch(batch);
+        return batch;
+    }
+
+    void Database::pending_batch(TodoBatch& batch) {
+        // Text is reserved from a typical row size, the arena grows from
+        // there if the tasks are longer
+        constexpr std::size_t TYPICAL_ROW_TEXT = 96;
+
+        with_reader([&batch](Connection& connection) {
+            std::int64_t count = 0;
+            {
+                auto query = connection.prepare("SELECT COUNT(*) FROM pending");
+                if (query->executeStep()) {
+                    count = query->getColumn(0).getInt64();
+                }
+            }
 
-            spdlog::info("new task ({}, {}, {}, {})", uuid, name, description, date);
-            all_tasks.push_back(
-                Todo{.id = uuid, .name = name, .description = description, .created_at = str_to_time(date)});
+            batch.clear();
+            batch.reserve(static_cast<std::size_t>(count), static_cast<std::size_t>(count) * TYPICAL_ROW_TEXT);
+
+            stream_pending(connection, [&batch](TodoRow const& row) { batch.push_back(row); }, 0, NO_LIMIT);
+        });
+    }
+
+    std::int64_t Database::for_each_pending(TodoVisitor const& visit, std::int64_t after_row_id, std::int64_t limit) {
+        auto last_row_id = after_row_id;
+        with_reader([&](Connection& connection) {
+            last_row_id = stream_pending(connection, visit, after_row_id, limit);
+        });
+
+        return last_row_id;
+    }
+
+    std::int64_t Database::stream_pending(
+        Connection& connection, TodoVisitor const& visit, std::int64_t after_row_id, std::int64_t limit) {
+        auto query = connection.prepare(
+            "SELECT id, uuid, name, description, created_at FROM pending WHERE id > ? ORDER BY id LIMIT ?");
+        query->bind(1, after_row_id);
+        query->bind(2, limit);
+
+        auto last_row_id = after_row_id;
+        while (query->executeStep()) {
+            TodoRow const row{.row_id = query->getColumn(0).getInt64(),
+             .id                      = column_text(query->getColumn(1)),
+             .name                    = column_text(query->getColumn(2)),
+             .description             = column_text(query->getColumn(3)),
+             .created_at              = column_time(query->getColumn(4))};
+
+            visit(row);
+            last_row_id = row.row_id;
         }
 
-        return all_tasks;
+        return last_row_id;
     }
 
-    bool Database::mark_task_done(std::string const& uuid) {
+    std::vector<SearchResult> Database::search(std::string_view query, std::size_t limit) {
+        std::vector<SearchResult> results;
 
-        SQLite::Statement query(*_db, "DELETE FROM pending WHERE uuid = ?");
+        auto const expression = to_match_expression(query);
+        if (expression.empty()) {
+            return results;
+        }
+
+        with_reader([&](Connection& connection) {
+            // Name matches weigh more than description matches
+            auto statement = connection.prepare(
+                "SELECT uuid, name, snippet(todo_search, -1, '[', ']', '...', 12), rowid % 2, "
+                "bm25(todo_search, 10.0, 1.0) AS rank "
+                "FROM todo_search WHERE todo_search MATCH ? ORDER BY rank LIMIT ?");
+            statement->bind(1, expression);
+            statement->bind(2, static_cast<std::int64_t>(limit));
+
+            while (statement->executeStep()) {
+                results.push_back(SearchResult{.id = statement->getColumn(0).getString(),
+                 .name                             = statement->getColumn(1).getString(),
+                 .snippet                          = statement->getColumn(2).getString(),
+                 .completed                        = statement->getColumn(3).getInt64() == 1,
+                 .rank                             = statement->getColumn(4).getDouble()});
+            }
+        });
 
-        int affected = query.exec();
-        if (affected <= 0) {
-            spdlog::error("task {} was not deleted", uuid);
+        return results;
+    }
+
+    bool Database::mark_task_done(std::string const& uuid) {
+        if (mark_tasks_done(std::span{&uuid, 1}) != 1) {
+            spdlog::error("task {} was not marked as done", uuid);
             return false;
         }
 
-        // TODO : We probably want to add this task to the other table that
-        // TODO : tracks the done tasks. It should have "created_at" and "done_at"
-
         return true;
     }
 
+    std::size_t Database::mark_tasks_done(std::span<std::string const> uuids) {
+        std::size_t moved = 0;
+
+        try {
+            with_writer([&moved, uuids](Connection& connection) {
+                auto copy_task = connection.prepare(
+                    "INSERT INTO completed (uuid, name, description, created_at, completed_at) "
+                    "SELECT uuid, name, description, created_at, ? FROM pending WHERE uuid = ?");
+                auto delete_task = connection.prepare("DELETE FROM pending WHERE uuid = ?");
+
+                auto const completed_at = to_epoch_ms(std::chrono::system_clock::now());
+                for (auto const& uuid : uuids) {
+                    copy_task->bind(1, completed_at);
+                    copy_task->bind(2, uuid);
+                    auto const copied = copy_task->exec();
+                    copy_task->reset();
+
+                    if (copied == 0) {
+                        spdlog::warn("task {} is not pending, skipping", uuid);
+                        continue;
+                    }
+
+                    delete_task->bind(1, uuid);
+                    delete_task->exec();
+                    delete_task->reset();
+                    ++moved;
+                }
+            });
+        } catch (SQLite::Exception const& e) {
+            spdlog::error("could not mark {} tasks as done: {}", uuids.size(), e.what());
+            return 0;
+        }
+
+        return moved;
+    }
+
 } // namespace fachory::db
@@ -0,0 +1,44 @@
+#ifndef DATABASE_CIPHER_H
+#define DATABASE_CIPHER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace fachory::db {
+
+    // SQLCipher settings, the defaults are SQLCipher 4's. page_size and
+    // hmac_algorithm have to match what the file was created with, kdf_iter
+    // and kdf_algorithm are how a passphrase is turned into its key.
+    struct CipherConfig {
+        std::int64_t kdf_iter      = 256'000;
+        std::int64_t page_size     = 4096;
+        std::string kdf_algorithm  = "PBKDF2_HMAC_SHA512";
+        std::string hmac_algorithm = "HMAC_SHA512";
+    };
+
+    inline constexpr std::size_t CIPHER_KEY_BYTES  = 32;
+    inline constexpr std::size_t CIPHER_SALT_BYTES = 16;
+
+    using CipherSalt = std::array<unsigned char, CIPHER_SALT_BYTES>;
+
+    // x'...' holding 64 hex digits of key, optionally followed by 32 of salt
+    [[nodiscard]] bool is_raw_key(std::string_view key);
+
+    // The raw key, salt included, that SQLCipher derives from passphrase.
+    // Runs all kdf_iter rounds, see connection_key for the cached form.
+    [[nodiscard]] std::string derive_raw_key(
+        std::string_view passphrase, CipherSalt const& salt, CipherConfig const& cipher);
+
+    // What every connection to db_file is keyed with. A raw key is used as
+    // is. A passphrase is derived with the salt SQLCipher stored at the start
+    // of the file, or a new one for a new file, once per process for each
+    // file, passphrase and settings.
+    [[nodiscard]] std::string connection_key(
+        std::string const& db_file, std::string const& db_key, CipherConfig const& cipher);
+} // namespace fachory::db
+
+
+#endif // DATABASE_CIPHER_H
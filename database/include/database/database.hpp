@@ -1,43 +1,136 @@
 #ifndef DATABASE_DATABASE_H
 #define DATABASE_DATABASE_H
 
+#include <database/cipher.hpp>
+#include <database/todo.hpp>
+#include <database/todo_batch.hpp>
+
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
 #include <stdexcept>
 #include <string>
-
-namespace SQLite {
-    class Database;
-}
+#include <string_view>
+#include <vector>
 
 namespace fachory::db {
 
-    using Time = std::chrono::time_point<std::chrono::system_clock>;
+    using TodoVisitor = std::function<void(TodoRow const& row)>;
+
+    enum class ChangeKind { Inserted, Updated, Deleted };
 
-    struct Todo {
-        std::string id;
-        std::string name;
-        std::string description;
-        Time created_at;
+    // table is "pending" or "completed"
+    struct RowChange {
+        std::string_view table;
+        ChangeKind kind;
+        std::int64_t row_id;
     };
 
+    using ChangeCallback = std::function<void(std::span<RowChange const> changes)>;
+    using SubscriptionId = std::uint64_t;
+
     class DatabaseException : public std::runtime_error {
 
     public:
         explicit DatabaseException(std::string const& message);
     };
 
+    struct DatabaseConfig {
+        // WAL journal, reads served by a pool of read-only connections and
+        // every write going through one writer thread that commits whatever
+        // is queued in one transaction. Off keeps a single connection.
+        bool concurrent = false;
+
+        // Read-only connections, one per hardware thread when zero
+        std::size_t readers = 0;
+
+        // Applied to every connection in concurrent mode
+        std::string synchronous                = "NORMAL";
+        std::int64_t mmap_size                 = 256 * 1024 * 1024;
+        std::int64_t cache_size_kib            = 16 * 1024;
+        std::chrono::milliseconds busy_timeout = std::chrono::seconds{5};
+
+        // Applied to every connection. Recorded in schema_meta, and checked
+        // against what was recorded, whenever the database is migrated or
+        // opened with settings other than last time.
+        CipherConfig cipher = {};
+    };
+
+    // Statements are prepared once and cached on the connection they were
+    // prepared on. Only thread safe in concurrent mode, a single connection
+    // database must be used from one thread at a time.
     class Database {
     public:
-        Database(std::string const& db_file, std::string const& db_key);
+        static constexpr std::int64_t NO_LIMIT            = -1;
+        static constexpr std::size_t DEFAULT_SEARCH_LIMIT = 20;
+
+        // db_key is a passphrase, or a raw key as x'...' (see is_raw_key)
+        // which skips key derivation altogether. A passphrase is derived
+        // once per process, connections are all opened with the result.
+        Database(std::string const& db_file, std::string const& db_key, DatabaseConfig const& config = {});
         ~Database();
 
         [[nodiscard]] std::vector<Todo> pending_tasks();
 
+        // All pending tasks in one TodoBatch, sized up front from a count.
+        // The second form refills a batch, reusing the memory it holds.
+        [[nodiscard]] TodoBatch pending_batch();
+        void pending_batch(TodoBatch& batch);
+
+        // Streams the pending tasks with a row id above after_row_id, in row
+        // id order and at most limit of them. Rows point into the query and
+        // only live for the duration of the visit. Returns the row id the
+        // next page starts after, after_row_id itself when there were no rows.
+        std::int64_t for_each_pending(
+            TodoVisitor const& visit, std::int64_t after_row_id = 0, std::int64_t limit = NO_LIMIT);
+
         [[nodiscard]] bool mark_task_done(std::string const& uuid);
 
+        // Moves the tasks from pending to completed in a single transaction,
+        // so the whole batch costs one commit. Unknown uuids are skipped.
+        // Returns how many tasks were moved, nothing is moved on error.
+        std::size_t mark_tasks_done(std::span<std::string const> uuids);
+
+        // Full-text search over the name and description of pending and
+        // completed tasks, best match first. Every word has to match, the
+        // last one as a prefix so partly typed queries find results.
+        [[nodiscard]] std::vector<SearchResult> search(
+            std::string_view query, std::size_t limit = DEFAULT_SEARCH_LIMIT);
+
+        // Calls callback after every commit that changed tasks, with the net
+        // change per row: a row inserted and deleted within one commit isn't
+        // reported. Only commits made through this Database's writer are
+        // seen, never those of other connections or processes to the same
+        // file. Callbacks run on the thread that committed, the writer
+        // thread in concurrent mode, and must not write to the database.
+        SubscriptionId subscribe(ChangeCallback callback);
+        void unsubscribe(SubscriptionId id);
+
     private:
-        std::unique_ptr<SQLite::Database> _db;
+        struct Connection;
+        struct ChangeFeed;
+        struct Engine;
+
+        // The writer, and the only connection outside concurrent mode
+        std::unique_ptr<Connection> _connection;
+
+        // Hooked into the writer, collecting row changes until they commit
+        std::unique_ptr<ChangeFeed> _changes;
+
+        // Reader pool and writer thread, only in concurrent mode
+        std::unique_ptr<Engine> _engine;
+
+        // Runs read on an idle reader, or on the single connection
+        void with_reader(std::function<void(Connection&)> const& read);
+
+        // Runs write in a transaction on the writer, rethrowing what it threw
+        void with_writer(std::function<void(Connection&)> write);
+
+        static std::int64_t stream_pending(
+            Connection& connection, TodoVisitor const& visit, std::int64_t after_row_id, std::int64_t limit);
     };
 }; // namespace fachory::db
 
@@ -0,0 +1,24 @@
+#ifndef DATABASE_TIME_H
+#define DATABASE_TIME_H
+
+#include <database/todo.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace fachory::db {
+
+    // Timestamps are stored as INTEGER milliseconds since the Unix epoch
+    [[nodiscard]] std::int64_t to_epoch_ms(Time time);
+    [[nodiscard]] Time from_epoch_ms(std::int64_t milliseconds);
+
+    // Parses timestamps left as text by older versions, without allocating.
+    // Accepts ISO-8601 ("2014-01-09 12:35:34", with an optional T separator,
+    // fractional seconds and Z or +HH:MM offset) and the legacy
+    // "Jan 9 2014 12:35:34" form. Times without an offset are UTC.
+    [[nodiscard]] std::optional<Time> parse_time(std::string_view text);
+} // namespace fachory::db
+
+
+#endif // DATABASE_TIME_H
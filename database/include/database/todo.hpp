@@ -0,0 +1,44 @@
+#ifndef DATABASE_TODO_H
+#define DATABASE_TODO_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace fachory::db {
+
+    using Time = std::chrono::time_point<std::chrono::system_clock>;
+
+    struct Todo {
+        std::string id;
+        std::string name;
+        std::string description;
+        Time created_at;
+    };
+
+    // A task that doesn't own its text. The views point into whatever the
+    // row was read from: the current row of a query, or a TodoBatch.
+    struct TodoRow {
+        std::int64_t row_id;
+        std::string_view id;
+        std::string_view name;
+        std::string_view description;
+        Time created_at;
+    };
+
+    struct SearchResult {
+        std::string id;
+        std::string name;
+
+        // Best matching fragment, with the matched terms in [brackets]
+        std::string snippet;
+        bool completed;
+
+        // bm25, lower is a better match
+        double rank;
+    };
+} // namespace fachory::db
+
+
+#endif // DATABASE_TODO_H
@@ -0,0 +1,52 @@
+#ifndef DATABASE_TODO_BATCH_H
+#define DATABASE_TODO_BATCH_H
+
+#include <database/todo.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace fachory::db {
+
+    // Tasks stored by column. The text of every row is packed into one
+    // arena, so loading n tasks takes a few allocations rather than up to
+    // 3n. Rows handed out are views into the batch, valid until it changes.
+    class TodoBatch {
+    public:
+        TodoBatch() = default;
+
+        // Room for rows tasks with text_bytes of text between them
+        void reserve(std::size_t rows, std::size_t text_bytes);
+
+        void push_back(TodoRow const& row);
+
+        // Drops the rows, keeping the allocated memory for the next load
+        void clear();
+
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] bool empty() const;
+
+        [[nodiscard]] TodoRow operator[](std::size_t index) const;
+
+        [[nodiscard]] std::span<std::int64_t const> row_ids() const;
+        [[nodiscard]] std::span<Time const> created_at() const;
+
+    private:
+        // Each row adds the end of its id, name and description to _ends,
+        // all three relative to the start of the arena
+        static constexpr std::size_t TEXT_COLUMNS = 3;
+
+        std::string _arena;
+        std::vector<std::size_t> _ends;
+        std::vector<std::int64_t> _row_ids;
+        std::vector<Time> _created_at;
+
+        [[nodiscard]] std::string_view text(std::size_t index, std::size_t column) const;
+    };
+} // namespace fachory::db
+
+
+#endif // DATABASE_TODO_BATCH_H
@@ -0,0 +1,166 @@
+#include <database/time.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace {
+
+    constexpr std::array<std::string_view, 12> MONTH_NAMES{
+     "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    // Reads between min_digits and max_digits decimal digits, advancing
+    // position past them
+    bool read_number(
+        std::string_view text, std::size_t& position, std::size_t min_digits, std::size_t max_digits, int& value) {
+        std::size_t digits = 0;
+        value              = 0;
+        while (digits < max_digits && position < text.size() && text[position] >= '0' && text[position] <= '9') {
+            value = value * 10 + (text[position] - '0');
+            ++position;
+            ++digits;
+        }
+
+        return digits >= min_digits;
+    }
+
+    bool read_char(std::string_view text, std::size_t& position, char expected) {
+        if (position >= text.size() || text[position] != expected) {
+            return false;
+        }
+
+        ++position;
+        return true;
+    }
+
+    std::optional<fachory::db::Time> make_time(int year, int month, int day, int hour, int minute, int second,
+        int millisecond, int offset_minutes) {
+        using namespace std::chrono;
+
+        year_month_day const date{std::chrono::year{year}, std::chrono::month{static_cast<unsigned>(month)},
+         std::chrono::day{static_cast<unsigned>(day)}};
+        if (!date.ok() || hour > 23 || minute > 59 || second > 60) {
+            return std::nullopt;
+        }
+
+        auto const time = sys_days{date} + hours{hour} + minutes{minute} + seconds{second}
+                        + milliseconds{millisecond} - minutes{offset_minutes};
+        return std::make_optional<fachory::db::Time>(time);
+    }
+
+    // HH:MM[:SS[.fff]][Z|+HH:MM|-HH:MM], from position to the end
+    std::optional<fachory::db::Time> parse_clock(
+        std::string_view text, std::size_t position, int year, int month, int day) {
+        int hour = 0, minute = 0, second = 0, millisecond = 0;
+        if (!read_number(text, position, 2, 2, hour) || !read_char(text, position, ':')
+            || !read_number(text, position, 2, 2, minute)) {
+            return std::nullopt;
+        }
+
+        if (read_char(text, position, ':') && !read_number(text, position, 2, 2, second)) {
+            return std::nullopt;
+        }
+
+        if (read_char(text, position, '.')) {
+            // Only the first three digits matter, the rest are skipped
+            auto const start = position;
+            if (!read_number(text, position, 1, 3, millisecond)) {
+                return std::nullopt;
+            }
+            for (auto digits = position - start; digits < 3; ++digits) {
+                millisecond *= 10;
+            }
+
+            while (position < text.size() && text[position] >= '0' && text[position] <= '9') {
+                ++position;
+            }
+        }
+
+        int offset = 0;
+        if (position < text.size() && (text[position] == '+' || text[position] == '-')) {
+            auto const sign = text[position++] == '-' ? -1 : 1;
+            int offset_hours = 0, offset_minutes = 0;
+            if (!read_number(text, position, 2, 2, offset_hours)) {
+                return std::nullopt;
+            }
+            read_char(text, position, ':');
+            if (!read_number(text, position, 2, 2, offset_minutes)) {
+                return std::nullopt;
+            }
+            offset = sign * (offset_hours * 60 + offset_minutes);
+        } else {
+            read_char(text, position, 'Z');
+        }
+
+        if (position != text.size()) {
+            return std::nullopt;
+        }
+
+        return make_time(year, month, day, hour, minute, second, millisecond, offset);
+    }
+
+    // YYYY-MM-DD followed by a space or T and the time of day
+    std::optional<fachory::db::Time> parse_iso(std::string_view text) {
+        std::size_t position = 0;
+        int year = 0, month = 0, day = 0;
+        if (!read_number(text, position, 4, 4, year) || !read_char(text, position, '-')
+            || !read_number(text, position, 2, 2, month) || !read_char(text, position, '-')
+            || !read_number(text, position, 2, 2, day)) {
+            return std::nullopt;
+        }
+
+        if (position == text.size()) {
+            return make_time(year, month, day, 0, 0, 0, 0, 0);
+        }
+
+        if (!read_char(text, position, ' ') && !read_char(text, position, 'T')) {
+            return std::nullopt;
+        }
+
+        return parse_clock(text, position, year, month, day);
+    }
+
+    // "Jan 9 2014 12:35:34", what str_to_time used to expect
+    std::optional<fachory::db::Time> parse_legacy(std::string_view text) {
+        if (text.size() < 3) {
+            return std::nullopt;
+        }
+
+        int month = 0;
+        for (std::size_t i = 0; i < MONTH_NAMES.size(); ++i) {
+            if (text.substr(0, 3) == MONTH_NAMES[i]) {
+                month = static_cast<int>(i) + 1;
+                break;
+            }
+        }
+
+        std::size_t position = 3;
+        int year = 0, day = 0;
+        if (month == 0 || !read_char(text, position, ' ') || !read_number(text, position, 1, 2, day)
+            || !read_char(text, position, ' ') || !read_number(text, position, 4, 4, year)
+            || !read_char(text, position, ' ')) {
+            return std::nullopt;
+        }
+
+        return parse_clock(text, position, year, month, day);
+    }
+} // namespace
+
+namespace fachory::db {
+
+    std::int64_t to_epoch_ms(Time time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    Time from_epoch_ms(std::int64_t milliseconds) {
+        return Time{std::chrono::milliseconds{milliseconds}};
+    }
+
+    std::optional<Time> parse_time(std::string_view text) {
+        if (!text.empty() && text.front() >= '0' && text.front() <= '9') {
+            return parse_iso(text);
+        }
+
+        return parse_legacy(text);
+    }
+} // namespace fachory::db
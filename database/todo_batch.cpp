@@ -0,0 +1,58 @@
+#include <database/todo_batch.hpp>
+
+namespace fachory::db {
+
+    void TodoBatch::reserve(std::size_t rows, std::size_t text_bytes) {
+        _arena.reserve(text_bytes);
+        _ends.reserve(rows * TEXT_COLUMNS);
+        _row_ids.reserve(rows);
+        _created_at.reserve(rows);
+    }
+
+    void TodoBatch::push_back(TodoRow const& row) {
+        for (auto const column : {row.id, row.name, row.description}) {
+            _arena.append(column);
+            _ends.push_back(_arena.size());
+        }
+
+        _row_ids.push_back(row.row_id);
+        _created_at.push_back(row.created_at);
+    }
+
+    void TodoBatch::clear() {
+        _arena.clear();
+        _ends.clear();
+        _row_ids.clear();
+        _created_at.clear();
+    }
+
+    std::size_t TodoBatch::size() const {
+        return _row_ids.size();
+    }
+
+    bool TodoBatch::empty() const {
+        return _row_ids.empty();
+    }
+
+    TodoRow TodoBatch::operator[](std::size_t index) const {
+        return TodoRow{.row_id = _row_ids[index],
+         .id                   = text(index, 0),
+         .name                 = text(index, 1),
+         .description          = text(index, 2),
+         .created_at           = _created_at[index]};
+    }
+
+    std::span<std::int64_t const> TodoBatch::row_ids() const {
+        return _row_ids;
+    }
+
+    std::span<Time const> TodoBatch::created_at() const {
+        return _created_at;
+    }
+
+    std::string_view TodoBatch::text(std::size_t index, std::size_t column) const {
+        auto const slot  = index * TEXT_COLUMNS + column;
+        auto const begin = slot == 0 ? 0 : _ends[slot - 1];
+        return std::string_view{_arena}.substr(begin, _ends[slot] - begin);
+    }
+} // namespace fachory::db
@@ -0,0 +1,93 @@
+#ifndef FACHORY_CHANNEL_H
+#define FACHORY_CHANNEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace fachory {
+
+    // Bounded queue between two pipeline stages. A full channel blocks the
+    // stage feeding it, which is how a slow printer slows down reading.
+    // Closing lets the consumer drain what is left and then stop.
+    template <typename T>
+    class Channel {
+    public:
+        explicit Channel(std::size_t capacity) : _capacity{capacity < 1 ? std::size_t{1} : capacity} {}
+
+        Channel(Channel const&)            = delete;
+        Channel& operator=(Channel const&) = delete;
+
+        // Blocks while full, false when the channel was closed
+        bool push(T value) {
+            std::unique_lock lock{_mutex};
+            _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+            if (_closed) {
+                return false;
+            }
+
+            _items.push_back(std::move(value));
+            _not_empty.notify_one();
+            return true;
+        }
+
+        // Blocks until there is an item, std::nullopt once closed and drained
+        [[nodiscard]] std::optional<T> pop() {
+            std::unique_lock lock{_mutex};
+            _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+            return take();
+        }
+
+        // Like pop, but also std::nullopt when nothing came before deadline
+        [[nodiscard]] std::optional<T> pop_until(std::chrono::steady_clock::time_point deadline) {
+            std::unique_lock lock{_mutex};
+            _not_empty.wait_until(lock, deadline, [this] { return _closed || !_items.empty(); });
+            return take();
+        }
+
+        // Items still queued are popped as usual
+        void close() {
+            std::scoped_lock lock{_mutex};
+            _closed = true;
+            _not_empty.notify_all();
+            _not_full.notify_all();
+        }
+
+        [[nodiscard]] bool drained() const {
+            std::scoped_lock lock{_mutex};
+            return _closed && _items.empty();
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            std::scoped_lock lock{_mutex};
+            return _items.size();
+        }
+
+    private:
+        std::size_t const _capacity;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+        std::deque<T> _items;
+        bool _closed = false;
+
+        std::optional<T> take() {
+            if (_items.empty()) {
+                return std::nullopt;
+            }
+
+            std::optional<T> item{std::move(_items.front())};
+            _items.pop_front();
+            _not_full.notify_one();
+            return item;
+        }
+    };
+} // namespace fachory
+
+
+#endif // FACHORY_CHANNEL_H
@@ -1,54 +1,212 @@
+#include "pipeline.hpp"
+
 #include <database/database.hpp>
+#include <metrics/exporter.hpp>
+#include <metrics/trace.hpp>
 #include <printer/printer_manager.hpp>
 
+#include <cxxopts.hpp>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <optional>
+#include <signal.h>
+#include <string>
+#include <string_view>
+#include <vector>
 
-int main(int arc, char** arv) {
+namespace {
 
-    // Create Database
-    try {
-        fachory::db::Database test{"test.db", "password"};
-    } catch (fachory::db::DatabaseException const& e) {
-        spdlog::error("could not connect to datbaase: {}", e.what());
-        return -1;
-    }
+    int demo(cxxopts::ParseResult const& options) {
+
+        // Create Database
+        try {
+            fachory::db::Database test{options["db"].as<std::string>(), options["key"].as<std::string>()};
+        } catch (fachory::db::DatabaseException const& e) {
+            spdlog::error("could not connect to datbaase: {}", e.what());
+            return -1;
+        }
+
+        PrinterManager manager{};
+        if (!manager.wait_for_printers(std::chrono::seconds{2})) {
+            spdlog::warn("printer discovery is taking a while, the list may be incomplete");
+        }
+
+        for (auto const& printer : manager.printers()) {
+            std::cout << fmt::format("{}\n", printer);
+        }
+        std::cout << std::endl;
+
+        // Print one item
+        if (!manager.print_pdf("terow", "./memes/cat.pdf")) {
+            spdlog::error("could not print pdf");
+        }
 
-    PrinterManager manager{};
+        // clang-format off
+        std::array<std::string_view, 6> to_print{
+          "[ ] Going to the Gym",
+          "[ ] Helping BB",
+          "[ ] Eat fazenda",
+          "[ ] Do chore",
+          "[ ] Do Work",
+          "[ ] Do Food",
+        };
+        // clang-format on
 
-    for (auto const printer : manager.printers()) {
-        std::cout << fmt::format("{}\n", printer);
+        std::string whole_print;
+        for (auto const text : to_print) {
+            whole_print += '\n';
+            whole_print += text;
+        }
+
+        if (!manager.print_text("terow", whole_print)) {
+            spdlog::error("could not print");
+            return -1;
+        }
+
+        return 0;
     }
-    std::cout << std::endl;
 
-    // Print one item
-    if (!manager.print_pdf("terow", "./memes/cat.pdf")) {
-        spdlog::error("could not print pdf");
+    int serve(cxxopts::ParseResult const& options) {
+        if (!options.count("printer")) {
+            spdlog::error("serve needs at least one --printer");
+            return -1;
+        }
+        auto printers = options["printer"].as<std::vector<std::string>>();
+
+        // Blocked before any thread starts, so they all inherit the mask and
+        // only the sigwait below sees a shutdown request
+        sigset_t shutdown_signals;
+        sigemptyset(&shutdown_signals);
+        sigaddset(&shutdown_signals, SIGINT);
+        sigaddset(&shutdown_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+
+        std::optional<fachory::metrics::MetricsExporter> exporter;
+        if (options.count("metrics-file")) {
+            exporter.emplace(fachory::metrics::ExporterConfig{
+                .path     = options["metrics-file"].as<std::string>(),
+                .target   = fachory::metrics::ExportTarget::File,
+                .interval = std::chrono::milliseconds{options["metrics-interval"].as<std::size_t>()},
+            });
+        }
+
+#ifdef FACHORY_TRACING
+        std::optional<fachory::metrics::TraceDumper> tracer;
+        if (options.count("trace-file")) {
+            tracer.emplace(options["trace-file"].as<std::string>());
+        }
+#endif
+
+        std::optional<fachory::db::Database> database;
+        try {
+            database.emplace(options["db"].as<std::string>(), options["key"].as<std::string>(),
+                fachory::db::DatabaseConfig{.concurrent = true});
+        } catch (fachory::db::DatabaseException const& e) {
+            spdlog::error("could not connect to database: {}", e.what());
+            return -1;
+        }
+
+        PrinterManager manager{PrinterManagerConfig{
+            .queue_capacity = options["printer-queue"].as<std::size_t>(),
+            .coalescing     = CoalescingOptions{.enabled = options["coalesce"].as<bool>()},
+        }};
+        if (!manager.wait_for_printers(std::chrono::seconds{2})) {
+            spdlog::warn("printer discovery is taking a while, the first receipts may fail");
+        }
+
+        // More than one printer is served as a pool
+        auto const pool    = printers.size() > 1;
+        auto const printer = pool ? std::string{"serve"} : printers.front();
+        if (pool && !manager.create_pool(printer, std::move(printers), PoolPolicy::LeastOutstanding)) {
+            spdlog::error("could not create a pool of printers");
+            return -1;
+        }
+
+        {
+            fachory::Pipeline pipeline{*database, manager,
+                fachory::PipelineConfig{
+                    .printer       = printer,
+                    .pool          = pool,
+                    .read_batch    = options["read-batch"].as<std::size_t>(),
+                    .poll_interval = std::chrono::milliseconds{options["poll-interval"].as<std::size_t>()},
+                    .queue_depth   = options["queue-depth"].as<std::size_t>(),
+                    .done_batch    = options["done-batch"].as<std::size_t>(),
+                    .done_delay    = std::chrono::milliseconds{options["done-delay"].as<std::size_t>()},
+                }};
+            spdlog::info("serving pending tasks to {}", printer);
+
+            int signal = 0;
+            sigwait(&shutdown_signals, &signal);
+            spdlog::info("received signal {}, printing the tasks already read", signal);
+        }
+
+        spdlog::info("drained, stopping");
+        return 0;
     }
 
+} // namespace
+
+int main(int argc, char** argv) {
+    cxxopts::Options options{"fachory", "Prints todo lists on receipt printers"};
+    options.positional_help("[demo|serve]");
+
     // clang-format off
-    std::array<std::string, 6> to_print{
-      "[ ] Going to the Gym",
-      "[ ] Helping BB",
-      "[ ] Eat fazenda",
-      "[ ] Do chore",
-      "[ ] Do Work",
-      "[ ] Do Food",
-    };
+    options.add_options()
+        ("h,help", "Print this help")
+        ("command", "demo prints a sample list, serve prints pending tasks until stopped",
+            cxxopts::value<std::string>()->default_value("demo"))
+        ("db", "Database file", cxxopts::value<std::string>()->default_value("test.db"))
+        ("key", "Database key", cxxopts::value<std::string>()->default_value("password"));
+
+    options.add_options("serve")
+        ("printer", "Printer to print on, repeat to pool several", cxxopts::value<std::vector<std::string>>())
+        ("read-batch", "Pending tasks read per query", cxxopts::value<std::size_t>()->default_value("64"))
+        ("poll-interval", "Milliseconds between reads when no insert was seen",
+            cxxopts::value<std::size_t>()->default_value("1000"))
+        ("queue-depth", "Tasks queued between each pair of stages",
+            cxxopts::value<std::size_t>()->default_value("32"))
+        ("printer-queue", "Jobs queued per printer", cxxopts::value<std::size_t>()->default_value("64"))
+        ("coalesce", "Merge bursts of receipts for a printer into one job")
+        ("done-batch", "Printed tasks marked done per commit", cxxopts::value<std::size_t>()->default_value("32"))
+        ("done-delay", "Longest a printed task waits to be marked done, in milliseconds",
+            cxxopts::value<std::size_t>()->default_value("200"))
+        ("metrics-file", "Write Prometheus metrics to this file", cxxopts::value<std::string>())
+        ("metrics-interval", "Milliseconds between metrics writes",
+            cxxopts::value<std::size_t>()->default_value("15000"));
     // clang-format on
 
-    std::string whole_print = "";
-    for (auto const text : to_print) {
-        whole_print = fmt::format("{}\n{}", whole_print, text);
-    }
+    // Only offered when there are spans to write
+#ifdef FACHORY_TRACING
+    options.add_options("serve")("trace-file", "Write a Chrome trace here on SIGUSR2", cxxopts::value<std::string>());
+#endif
+
+    options.parse_positional({"command"});
+
+    try {
+        auto const result = options.parse(argc, argv);
+        if (result.count("help")) {
+            std::cout << options.help({"", "serve"}) << std::endl;
+            return 0;
+        }
+
+        auto const command = result["command"].as<std::string>();
+        if (command == "demo") {
+            return demo(result);
+        }
+        if (command == "serve") {
+            return serve(result);
+        }
 
-    if (!manager.print_text("terow", whole_print)) {
-        spdlog::error("could not print");
-        return -1;
+        spdlog::error("unknown command {}, expected demo or serve", command);
+    } catch (cxxopts::exceptions::exception const& e) {
+        spdlog::error("{}", e.what());
     }
 
-    return 0;
+    std::cerr << options.help({"", "serve"}) << std::endl;
+    return -1;
 }
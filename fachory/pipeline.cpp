@@ -0,0 +1,260 @@
+#include "pipeline.hpp"
+
+#include <metrics/metrics.hpp>
+#include <metrics/trace.hpp>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <ctime>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace fachory {
+
+    namespace {
+
+        // Feeds the paper past the tear bar once a receipt is done
+        constexpr std::string_view RECEIPT_FEED = "\n\n\n\n";
+
+        // Receipts are read next to the printer, in its time zone rather
+        // than the UTC the database stores
+        std::tm local_time(db::Time time) {
+            auto const seconds = std::chrono::system_clock::to_time_t(time);
+            std::tm local{};
+            localtime_r(&seconds, &local);
+            return local;
+        }
+
+    } // namespace
+
+    Pipeline::Pipeline(db::Database& database, PrinterManager& printers, PipelineConfig config)
+        : _database{database}, _printers{printers}, _config{std::move(config)}, _in_flight{}, _retry_from{},
+          _retry_at{}, _to_render{_config.queue_depth}, _to_dispatch{_config.queue_depth},
+          _to_complete{_config.queue_depth} {
+        _completer  = std::jthread{[this] { complete(); }};
+        _dispatcher = std::jthread{[this] { dispatch(); }};
+        _renderer   = std::jthread{[this] { render(); }};
+        _reader     = std::jthread{[this](std::stop_token stop) { read(std::move(stop)); }};
+    }
+
+    Pipeline::~Pipeline() {
+        drain();
+    }
+
+    void Pipeline::drain() {
+        // Every stage closes its output once its input is drained, so
+        // stopping the reader winds the others down in order
+        for (auto* stage : {&_reader, &_renderer, &_dispatcher, &_completer}) {
+            stage->request_stop();
+            if (stage->joinable()) {
+                stage->join();
+            }
+        }
+    }
+
+    void Pipeline::read(std::stop_token stop) {
+        // Tasks are read in row id order, so everything up to here has been
+        // handed on and only newer tasks are left, apart from failed ones the
+        // cursor is moved back for. pending.id never hands out an id twice, a
+        // new task always lands above the cursor.
+        std::int64_t after_row_id = 0;
+
+        std::vector<Task> tasks;
+        tasks.reserve(_config.read_batch);
+
+        while (!stop.stop_requested()) {
+            tasks.clear();
+            std::size_t rows = 0;
+            try {
+                // Held over the read, so a row can't be marked done and leave
+                // _in_flight between being read and being checked
+                std::scoped_lock lock{_retry_mutex};
+                if (_retry_from && std::chrono::steady_clock::now() >= _retry_at) {
+                    after_row_id = std::min(after_row_id, *_retry_from - 1);
+                    _retry_from.reset();
+                }
+
+                after_row_id = _database.for_each_pending(
+                    [&](db::TodoRow const& row) {
+                        ++rows;
+                        if (!_in_flight.insert(row.row_id).second) {
+                            return;
+                        }
+
+                        tasks.push_back(Task{.row_id = row.row_id,
+                         .uuid                       = std::string{row.id},
+                         .name                       = std::string{row.name},
+                         .description                = std::string{row.description},
+                         .created_at                 = row.created_at,
+                         .read_at                    = std::chrono::steady_clock::now()});
+                    },
+                    after_row_id, static_cast<std::int64_t>(_config.read_batch));
+            } catch (std::exception const& e) {
+                // The cursor didn't move, the whole batch is read again
+                std::scoped_lock lock{_retry_mutex};
+                for (auto const& task : tasks) {
+                    _in_flight.erase(task.row_id);
+                }
+                tasks.clear();
+                spdlog::error("could not read pending tasks: {}", e.what());
+            }
+
+            metrics::add(metrics::Counter::ServeTasksRead, tasks.size());
+            for (auto& task : tasks) {
+                (void)_to_render.push(std::move(task));
+            }
+
+            // A full batch means there may be more right away
+            if (rows == _config.read_batch) {
+                continue;
+            }
+
+            std::unique_lock lock{_sleep_mutex};
+            _sleep_cv.wait_for(lock, stop, _config.poll_interval, [] { return false; });
+        }
+
+        _to_render.close();
+    }
+
+    void Pipeline::render() {
+        // Reused for every receipt, each payload is then allocated once at
+        // its final size
+        fmt::memory_buffer buffer;
+
+        while (auto task = _to_render.pop()) {
+            FACHORY_TRACE_SCOPE("render_receipt");
+
+            buffer.clear();
+            auto out = std::back_inserter(buffer);
+            fmt::format_to(out, "[ ] {}\n", task->name);
+            if (!task->description.empty()) {
+                fmt::format_to(out, "    {}\n", task->description);
+            }
+            fmt::format_to(out, "{:%Y-%m-%d %H:%M}{}", local_time(task->created_at), RECEIPT_FEED);
+
+            (void)_to_dispatch.push(Receipt{.row_id = task->row_id,
+             .uuid                                = std::move(task->uuid),
+             .payload                             = PrintPayload::text(std::string{buffer.data(), buffer.size()}),
+             .read_at                             = task->read_at});
+        }
+
+        _to_dispatch.close();
+    }
+
+    void Pipeline::dispatch() {
+        while (auto receipt = _to_dispatch.pop()) {
+            // Blocks while the printer's own queue is full
+            auto result = _config.pool ? _printers.submit_to_pool(_config.printer, std::move(receipt->payload))
+                                       : _printers.submit(_config.printer, std::move(receipt->payload));
+
+            (void)_to_complete.push(InFlight{.row_id = receipt->row_id,
+             .uuid                                   = std::move(receipt->uuid),
+             .result                                 = std::move(result),
+             .read_at                                = receipt->read_at});
+        }
+
+        _to_complete.close();
+    }
+
+    void Pipeline::complete() {
+        std::vector<std::string> done;
+        std::vector<std::int64_t> row_ids;
+        std::vector<std::chrono::steady_clock::time_point> read_at;
+        done.reserve(_config.done_batch);
+        row_ids.reserve(_config.done_batch);
+        read_at.reserve(_config.done_batch);
+
+        std::optional<std::chrono::steady_clock::time_point> flush_at;
+        for (;;) {
+            auto job = flush_at ? _to_complete.pop_until(*flush_at) : _to_complete.pop();
+            if (!job) {
+                mark_done(done, row_ids, read_at);
+                flush_at.reset();
+                if (_to_complete.drained()) {
+                    return;
+                }
+                continue;
+            }
+
+            // Waits in submission order, a later job finishing first is
+            // only marked done a little later
+            auto const result = job->result.get();
+            if (!result.success) {
+                metrics::add(metrics::Counter::ServeTasksFailed);
+                spdlog::warn("could not print task {}, it is tried again: {}", job->uuid, result.error);
+                retry(job->row_id);
+                continue;
+            }
+
+            done.push_back(std::move(job->uuid));
+            row_ids.push_back(job->row_id);
+            read_at.push_back(job->read_at);
+            if (!flush_at) {
+                flush_at = std::chrono::steady_clock::now() + _config.done_delay;
+            }
+
+            if (done.size() >= _config.done_batch) {
+                mark_done(done, row_ids, read_at);
+                flush_at.reset();
+            }
+        }
+    }
+
+    void Pipeline::mark_done(std::vector<std::string>& uuids, std::vector<std::int64_t>& row_ids,
+        std::vector<std::chrono::steady_clock::time_point>& read_at) {
+        if (uuids.empty()) {
+            return;
+        }
+
+        // Tasks left pending are printed again once a failed task moves the
+        // reader back past them, or the next time the pipeline starts
+        try {
+            auto const moved = _database.mark_tasks_done(uuids);
+            if (moved != uuids.size()) {
+                spdlog::warn("only {} of {} printed tasks were marked done", moved, uuids.size());
+            }
+            metrics::add(metrics::Counter::ServeTasksPrinted, moved);
+
+            auto const now = std::chrono::steady_clock::now();
+            for (auto const read : read_at) {
+                metrics::record(metrics::Timer::ServeTaskLatency, now - read);
+            }
+        } catch (std::exception const& e) {
+            metrics::add(metrics::Counter::ServeTasksFailed, uuids.size());
+            spdlog::error("could not mark {} printed tasks done, they may print again: {}", uuids.size(), e.what());
+        }
+
+        // Only once committed, the reader must not find them pending and
+        // no longer in flight
+        settle(row_ids);
+
+        uuids.clear();
+        row_ids.clear();
+        read_at.clear();
+    }
+
+    void Pipeline::settle(std::span<std::int64_t const> row_ids) {
+        std::scoped_lock lock{_retry_mutex};
+        for (auto const row_id : row_ids) {
+            _in_flight.erase(row_id);
+        }
+    }
+
+    void Pipeline::retry(std::int64_t row_id) {
+        std::scoped_lock lock{_retry_mutex};
+        _in_flight.erase(row_id);
+
+        // Waits from the first failure, a printer that keeps failing is
+        // tried once per poll_interval rather than as fast as it fails
+        if (!_retry_from) {
+            _retry_at = std::chrono::steady_clock::now() + _config.poll_interval;
+        }
+        _retry_from = std::min(_retry_from.value_or(row_id), row_id);
+    }
+} // namespace fachory
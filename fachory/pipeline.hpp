@@ -0,0 +1,131 @@
+#ifndef FACHORY_PIPELINE_H
+#define FACHORY_PIPELINE_H
+
+#include "channel.hpp"
+
+#include <database/database.hpp>
+#include <printer/printer_manager.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fachory {
+
+    struct PipelineConfig {
+        // Printer, or pool when pool is set, every receipt is sent to
+        std::string printer;
+        bool pool = false;
+
+        // Pending tasks read per query, and how long the reader sleeps when
+        // it is caught up. Tasks are inserted by other processes, which no
+        // change subscription sees, so new ones wait for the next poll.
+        std::size_t read_batch                  = 64;
+        std::chrono::milliseconds poll_interval = std::chrono::seconds{1};
+
+        // Capacity of each channel between stages. Bounds the tasks in
+        // flight, and with them memory and end-to-end latency.
+        std::size_t queue_depth = 32;
+
+        // Printed tasks are marked done done_batch at a time, or done_delay
+        // after the first of them printed, whichever comes first
+        std::size_t done_batch               = 32;
+        std::chrono::milliseconds done_delay = std::chrono::milliseconds{200};
+    };
+
+    // Prints pending tasks as receipts and marks them done, each stage on its
+    // own thread with a bounded channel to the next:
+    //
+    //   reader -> renderer -> dispatcher -> completer
+    //
+    // A task that fails to print stays pending and is read again once
+    // poll_interval has passed. The database must be in concurrent mode, the
+    // reader and the completer use it at the same time.
+    class Pipeline {
+    public:
+        Pipeline(db::Database& database, PrinterManager& printers, PipelineConfig config);
+        ~Pipeline();
+
+        Pipeline(Pipeline const&)            = delete;
+        Pipeline& operator=(Pipeline const&) = delete;
+
+        // Stops reading new tasks and waits for the ones already read to be
+        // printed and marked done
+        void drain();
+
+    private:
+        struct Task {
+            std::int64_t row_id;
+            std::string uuid;
+            std::string name;
+            std::string description;
+            db::Time created_at;
+            std::chrono::steady_clock::time_point read_at;
+        };
+
+        struct Receipt {
+            std::int64_t row_id;
+            std::string uuid;
+            PrintPayload payload;
+            std::chrono::steady_clock::time_point read_at;
+        };
+
+        struct InFlight {
+            std::int64_t row_id;
+            std::string uuid;
+            std::future<JobResult> result;
+            std::chrono::steady_clock::time_point read_at;
+        };
+
+        db::Database& _database;
+        PrinterManager& _printers;
+        PipelineConfig const _config;
+
+        // Only there so a stop request ends the reader's sleep early
+        std::mutex _sleep_mutex;
+        std::condition_variable_any _sleep_cv;
+
+        // Rows read and not yet failed or marked done. A failed row moves the
+        // reader back to it once _retry_at has passed, and the rows re-read on
+        // the way that are still in flight are skipped rather than printed
+        // twice.
+        std::mutex _retry_mutex;
+        std::set<std::int64_t> _in_flight;
+        std::optional<std::int64_t> _retry_from;
+        std::chrono::steady_clock::time_point _retry_at;
+
+        Channel<Task> _to_render;
+        Channel<Receipt> _to_dispatch;
+        Channel<InFlight> _to_complete;
+
+        // Joined in reverse, the reader first
+        std::jthread _completer;
+        std::jthread _dispatcher;
+        std::jthread _renderer;
+        std::jthread _reader;
+
+        void read(std::stop_token stop);
+        void render();
+        void dispatch();
+        void complete();
+
+        void mark_done(std::vector<std::string>& uuids, std::vector<std::int64_t>& row_ids,
+            std::vector<std::chrono::steady_clock::time_point>& read_at);
+
+        // Called by the completer, row_ids are no longer in flight
+        void settle(std::span<std::int64_t const> row_ids);
+        void retry(std::int64_t row_id);
+    };
+} // namespace fachory
+
+
+#endif // FACHORY_PIPELINE_H
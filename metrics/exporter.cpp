@@ -0,0 +1,116 @@
+#include <metrics/exporter.hpp>
+
+#include <metrics/metrics.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace fachory::metrics {
+
+    namespace {
+
+        // Written next to the final name and renamed, like spilled payloads
+        bool write_file(std::filesystem::path const& path, std::string_view text) {
+            auto temp_path = path;
+            temp_path += ".tmp";
+
+            {
+                std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+                file.write(text.data(), static_cast<std::streamsize>(text.size()));
+                if (!file) {
+                    return false;
+                }
+            }
+
+            std::error_code error;
+            std::filesystem::rename(temp_path, path, error);
+            return !error;
+        }
+
+        bool write_socket(std::filesystem::path const& path, std::string_view text) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+
+            auto const native = path.string();
+            if (native.size() >= sizeof(address.sun_path)) {
+                return false;
+            }
+            std::memcpy(address.sun_path, native.c_str(), native.size() + 1);
+
+            auto const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                return false;
+            }
+
+            auto ok = ::connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) == 0;
+            while (ok && !text.empty()) {
+                auto const sent = ::send(fd, text.data(), text.size(), MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                ok   = sent > 0;
+                text = text.substr(ok ? static_cast<std::size_t>(sent) : text.size());
+            }
+
+            ::close(fd);
+            return ok;
+        }
+
+    } // namespace
+
+    MetricsExporter::MetricsExporter(ExporterConfig config)
+        : _config{std::move(config)}, _failing{false},
+          _exporter{[this](std::stop_token stop) { run(std::move(stop)); }} {}
+
+    MetricsExporter::~MetricsExporter() {
+        _exporter.request_stop();
+        if (_exporter.joinable()) {
+            _exporter.join();
+        }
+
+        export_now();
+    }
+
+    bool MetricsExporter::export_now() {
+        auto const text = to_prometheus(stats());
+        auto const ok   = _config.target == ExportTarget::File ? write_file(_config.path, text)
+                                                               : write_socket(_config.path, text);
+
+        // Only changes are logged, a missing scraper would flood the log
+        std::scoped_lock lock{_mutex};
+        if (!ok && !_failing) {
+            spdlog::warn("could not export metrics to {}", _config.path.string());
+        } else if (ok && _failing) {
+            spdlog::info("exporting metrics to {} again", _config.path.string());
+        }
+        _failing = !ok;
+
+        return ok;
+    }
+
+    void MetricsExporter::run(std::stop_token stop) {
+        while (!stop.stop_requested()) {
+            {
+                std::unique_lock lock{_mutex};
+                _wake.wait_for(lock, stop, _config.interval, [] { return false; });
+            }
+
+            if (stop.stop_requested()) {
+                return;
+            }
+
+            export_now();
+        }
+    }
+} // namespace fachory::metrics
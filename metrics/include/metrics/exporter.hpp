@@ -0,0 +1,50 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace fachory::metrics {
+
+    enum class ExportTarget { File, UnixSocket };
+
+    struct ExporterConfig {
+        // A file is replaced as a whole on every dump, so a scraper never
+        // reads half of one. A socket gets a connection per dump.
+        std::filesystem::path path;
+        ExportTarget target = ExportTarget::File;
+
+        std::chrono::milliseconds interval = std::chrono::seconds{15};
+    };
+
+    // Writes stats() in Prometheus text format every interval on its own
+    // thread, and one last time when destroyed
+    class MetricsExporter {
+    public:
+        explicit MetricsExporter(ExporterConfig config);
+        ~MetricsExporter();
+
+        MetricsExporter(MetricsExporter const&)            = delete;
+        MetricsExporter& operator=(MetricsExporter const&) = delete;
+
+        // Dumps right away, false when the target could not be written
+        bool export_now();
+
+    private:
+        ExporterConfig _config;
+
+        std::mutex _mutex;
+        std::condition_variable_any _wake;
+        bool _failing;
+
+        std::jthread _exporter;
+
+        void run(std::stop_token stop);
+    };
+} // namespace fachory::metrics
+
+
+#endif // METRICS_EXPORTER_H
@@ -0,0 +1,154 @@
+#ifndef METRICS_METRICS_H
+#define METRICS_METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FACHORY_METRICS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace fachory::metrics {
+
+    enum class Counter : std::uint8_t {
+        PrintJobsCreated,
+        PrintJobsFailed,
+        PrintBytesWritten,
+        ServeTasksRead,
+        ServeTasksPrinted,
+        ServeTasksFailed,
+        Count,
+    };
+
+    // Latency of each stage of a print, of database work, and of a task
+    // from being read by fachory serve to being marked done
+    enum class Timer : std::uint8_t {
+        PrintJobCreate,
+        PrintDocumentStart,
+        PrintDocumentWrite,
+        PrintJobFinish,
+        DbQuery,
+        DbCommit,
+        ServeTaskLatency,
+        Count,
+    };
+
+    inline constexpr std::size_t COUNTER_COUNT = static_cast<std::size_t>(Counter::Count);
+    inline constexpr std::size_t TIMER_COUNT   = static_cast<std::size_t>(Timer::Count);
+
+    // Log-linear buckets: exact below 2^SUB_BUCKET_BITS nanoseconds, then
+    // 2^SUB_BUCKET_BITS buckets per power of two (about 6% wide). Anything
+    // from 2^MAX_EXPONENT ns (about 18 minutes) on lands in the last bucket.
+    inline constexpr unsigned SUB_BUCKET_BITS      = 4;
+    inline constexpr unsigned MAX_EXPONENT         = 40;
+    inline constexpr std::size_t SUB_BUCKETS       = std::size_t{1} << SUB_BUCKET_BITS;
+    inline constexpr std::size_t HISTOGRAM_BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    [[nodiscard]] std::size_t bucket_index(std::uint64_t nanoseconds);
+
+    // Smallest value that lands in the bucket
+    [[nodiscard]] std::uint64_t bucket_lower_bound(std::size_t index);
+
+    struct HistogramSnapshot {
+        std::uint64_t count;
+        std::uint64_t sum_ns;
+        std::array<std::uint64_t, HISTOGRAM_BUCKETS> buckets;
+
+        // Upper edge of the bucket holding the q-th quantile, 0 when empty
+        [[nodiscard]] std::chrono::nanoseconds quantile(double q) const;
+    };
+
+    struct Stats {
+        std::array<std::uint64_t, COUNTER_COUNT> counters;
+        std::array<HistogramSnapshot, TIMER_COUNT> timers;
+
+        [[nodiscard]] std::uint64_t counter(Counter counter) const;
+        [[nodiscard]] HistogramSnapshot const& timer(Timer timer) const;
+    };
+
+    [[nodiscard]] char const* name(Counter counter);
+    [[nodiscard]] char const* name(Timer timer);
+
+    // Every thread records into its own block, so recording takes no lock
+    // and no atomic read-modify-write. Blocks of threads that exited are
+    // folded into a shared total.
+    void add(Counter counter, std::uint64_t value = 1);
+    void record(Timer timer, std::chrono::nanoseconds elapsed);
+
+    // Sums the blocks of every thread, each value read once without
+    // stopping the writers
+    [[nodiscard]] Stats stats();
+
+    // Prometheus text exposition format, with histograms reduced to a
+    // fixed set of le buckets from 1us to 10s
+    [[nodiscard]] std::string to_prometheus(Stats const& stats);
+
+    // A timestamp for timers, only the difference between two of them
+    // means anything. The TSC on x86-64, which reads in a fraction of the
+    // time steady_clock::now() takes, steady_clock nanoseconds elsewhere.
+    [[nodiscard]] inline std::uint64_t ticks() {
+#ifdef FACHORY_METRICS_TSC
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+#endif
+    }
+
+    // Records the time between two ticks() readings. The first call on
+    // x86-64 measures the TSC against steady_clock, which takes 2ms.
+    void record_ticks(Timer timer, std::uint64_t start, std::uint64_t end);
+
+    // Records the time from construction to destruction
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Timer timer) : _timer{timer}, _start{ticks()} {}
+        ~ScopedTimer() {
+            record_ticks(_timer, _start, ticks());
+        }
+
+        ScopedTimer(ScopedTimer const&)            = delete;
+        ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+    private:
+        Timer _timer;
+        std::uint64_t _start;
+    };
+
+    // Times stages that run back to back with one reading per boundary:
+    // every lap records the stage that just ended, which began at the
+    // previous lap or at construction, and starts the next one
+    class StageTimer {
+    public:
+        StageTimer() : _last{ticks()} {}
+
+        void lap(Timer timer) {
+            auto const now = ticks();
+            record_ticks(timer, _last, now);
+            _last = now;
+        }
+
+    private:
+        std::uint64_t _last;
+    };
+
+    // Runs work and records how long it took, returning what work returned
+    template <typename Work>
+    decltype(auto) timed(Timer timer, Work&& work) {
+        ScopedTimer scoped{timer};
+        return std::forward<Work>(work)();
+    }
+} // namespace fachory::metrics
+
+
+#endif // METRICS_METRICS_H
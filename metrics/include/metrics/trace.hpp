@@ -0,0 +1,80 @@
+#ifndef METRICS_TRACE_H
+#define METRICS_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <signal.h>
+#include <thread>
+
+namespace fachory::metrics {
+
+    // Every thread keeps its last TRACE_CAPACITY spans, older ones are
+    // overwritten. Spans of exited threads are kept until MAX_RETIRED_TRACES
+    // newer threads exited.
+    inline constexpr std::size_t TRACE_CAPACITY     = 8192;
+    inline constexpr std::size_t MAX_RETIRED_TRACES = 64;
+
+    // name is stored as is and must outlive the trace, pass a literal
+    void record_span(
+        char const* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    // Chrome trace-event JSON of the spans every thread still holds, for
+    // chrome://tracing or Perfetto. Without FACHORY_TRACING there are none,
+    // and the trace has no events.
+    [[nodiscard]] bool write_chrome_trace(std::filesystem::path const& path);
+
+    // Records a span from construction to destruction. Use it through
+    // FACHORY_TRACE_SCOPE so it is compiled out unless tracing is enabled.
+    class TraceSpan {
+    public:
+        explicit TraceSpan(char const* name) : _name{name}, _start{std::chrono::steady_clock::now()} {}
+        ~TraceSpan() {
+            record_span(_name, _start, std::chrono::steady_clock::now());
+        }
+
+        TraceSpan(TraceSpan const&)            = delete;
+        TraceSpan& operator=(TraceSpan const&) = delete;
+
+    private:
+        char const* _name;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // Writes the trace to path every time the process receives signal, and
+    // restores the previous handler when destroyed. One at a time. Only
+    // worth installing with FACHORY_TRACING, fachory doesn't offer it without.
+    class TraceDumper {
+    public:
+        explicit TraceDumper(std::filesystem::path path, int signal = SIGUSR2);
+        ~TraceDumper();
+
+        TraceDumper(TraceDumper const&)            = delete;
+        TraceDumper& operator=(TraceDumper const&) = delete;
+
+        // Dumps right away, false when the file could not be written
+        bool dump();
+
+    private:
+        std::filesystem::path _path;
+        int _signal;
+        int _wake_fds[2];
+        struct sigaction _previous;
+
+        std::jthread _dumper;
+
+        void run(std::stop_token stop);
+    };
+} // namespace fachory::metrics
+
+#define FACHORY_TRACE_CONCAT_IMPL(a, b) a##b
+#define FACHORY_TRACE_CONCAT(a, b)      FACHORY_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef FACHORY_TRACING
+#define FACHORY_TRACE_SCOPE(name) ::fachory::metrics::TraceSpan FACHORY_TRACE_CONCAT(trace_span_, __LINE__){name}
+#else
+#define FACHORY_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+
+#endif // METRICS_TRACE_H
@@ -0,0 +1,279 @@
+#include <metrics/metrics.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace fachory::metrics {
+
+    namespace {
+
+        struct TimerSlots {
+            std::atomic<std::uint64_t> count;
+            std::atomic<std::uint64_t> sum_ns;
+            std::array<std::atomic<std::uint64_t>, HISTOGRAM_BUCKETS> buckets;
+        };
+
+        // Written by its own thread only, read by anyone calling stats()
+        struct Block {
+            std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> counters{};
+            std::array<TimerSlots, TIMER_COUNT> timers{};
+        };
+
+        void bump(std::atomic<std::uint64_t>& slot, std::uint64_t value) {
+            // A plain load and store, the single writer can't lose updates
+            slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void add_block(Stats& stats, Block const& block) {
+            for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+                stats.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+            }
+
+            for (std::size_t i = 0; i < TIMER_COUNT; ++i) {
+                auto const& slots = block.timers[i];
+                auto& timer       = stats.timers[i];
+                timer.count += slots.count.load(std::memory_order_relaxed);
+                timer.sum_ns += slots.sum_ns.load(std::memory_order_relaxed);
+                for (std::size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+                    timer.buckets[bucket] += slots.buckets[bucket].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        class Registry {
+        public:
+            Block& attach() {
+                std::scoped_lock lock{_mutex};
+                return *_blocks.emplace_back(std::make_unique<Block>());
+            }
+
+            // Keeps what the exiting thread recorded
+            void detach(Block const* block) {
+                std::scoped_lock lock{_mutex};
+                add_block(_retired, *block);
+                std::erase_if(_blocks, [block](auto const& attached) { return attached.get() == block; });
+            }
+
+            Stats collect() {
+                std::scoped_lock lock{_mutex};
+                auto stats = _retired;
+                for (auto const& block : _blocks) {
+                    add_block(stats, *block);
+                }
+
+                return stats;
+            }
+
+        private:
+            std::mutex _mutex;
+            std::vector<std::unique_ptr<Block>> _blocks;
+            Stats _retired{};
+        };
+
+        // Never destroyed, threads may still exit after static destructors ran
+        Registry& registry() {
+            static auto* const instance = new Registry{};
+            return *instance;
+        }
+
+        struct ThreadBlock {
+            Block* block = nullptr;
+
+            ~ThreadBlock() {
+                if (block) {
+                    registry().detach(block);
+                }
+            }
+        };
+
+        thread_local ThreadBlock thread_block;
+
+        Block& local_block() {
+            auto*& block = thread_block.block;
+            if (!block) {
+                block = &registry().attach();
+            }
+
+            return *block;
+        }
+
+        // Measured once, against steady_clock, by the first timer recorded
+        double nanoseconds_per_tick() {
+#ifdef FACHORY_METRICS_TSC
+            static double const ratio = [] {
+                constexpr auto CALIBRATION = std::chrono::milliseconds{2};
+
+                auto const clock_start = std::chrono::steady_clock::now();
+                auto const tick_start  = ticks();
+                auto clock_end         = clock_start;
+                while (clock_end - clock_start < CALIBRATION) {
+                    clock_end = std::chrono::steady_clock::now();
+                }
+                auto const tick_end = ticks();
+
+                return std::chrono::duration<double, std::nano>{clock_end - clock_start}.count()
+                     / static_cast<double>(tick_end - tick_start);
+            }();
+            return ratio;
+#else
+            return 1.0;
+#endif
+        }
+
+        // Bucket edges Prometheus sees, in nanoseconds
+        constexpr std::array<std::uint64_t, 15> PROMETHEUS_BUCKETS{1'000, 5'000, 10'000, 50'000, 100'000, 500'000,
+         1'000'000, 5'000'000, 10'000'000, 50'000'000, 100'000'000, 500'000'000, 1'000'000'000, 5'000'000'000,
+         10'000'000'000};
+
+        std::string_view const COUNTER_NAMES[] = {
+         "print_jobs_created",
+         "print_jobs_failed",
+         "print_bytes_written",
+         "serve_tasks_read",
+         "serve_tasks_printed",
+         "serve_tasks_failed",
+        };
+
+        std::string_view const TIMER_NAMES[] = {
+         "print_job_create",
+         "print_document_start",
+         "print_document_write",
+         "print_job_finish",
+         "db_query",
+         "db_commit",
+         "serve_task_latency",
+        };
+
+        static_assert(std::size(COUNTER_NAMES) == COUNTER_COUNT);
+        static_assert(std::size(TIMER_NAMES) == TIMER_COUNT);
+
+    } // namespace
+
+    std::size_t bucket_index(std::uint64_t nanoseconds) {
+        if (nanoseconds < SUB_BUCKETS) {
+            return static_cast<std::size_t>(nanoseconds);
+        }
+
+        auto const exponent = static_cast<unsigned>(std::bit_width(nanoseconds)) - 1;
+        if (exponent >= MAX_EXPONENT) {
+            return HISTOGRAM_BUCKETS - 1;
+        }
+
+        auto const sub_bucket = (nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return ((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS) + static_cast<std::size_t>(sub_bucket);
+    }
+
+    std::uint64_t bucket_lower_bound(std::size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+
+        auto const group      = index / SUB_BUCKETS;
+        auto const sub_bucket = index % SUB_BUCKETS;
+        return static_cast<std::uint64_t>(SUB_BUCKETS + sub_bucket) << (group - 1);
+    }
+
+    std::chrono::nanoseconds HistogramSnapshot::quantile(double q) const {
+        if (count == 0) {
+            return std::chrono::nanoseconds{0};
+        }
+
+        auto const rank = std::max<std::uint64_t>(
+            1, static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count))));
+
+        std::uint64_t seen = 0;
+        for (std::size_t index = 0; index < HISTOGRAM_BUCKETS; ++index) {
+            seen += buckets[index];
+            if (seen >= rank) {
+                auto const edge = bucket_lower_bound(std::min(index + 1, HISTOGRAM_BUCKETS - 1));
+                return std::chrono::nanoseconds{static_cast<std::int64_t>(edge)};
+            }
+        }
+
+        return std::chrono::nanoseconds{static_cast<std::int64_t>(bucket_lower_bound(HISTOGRAM_BUCKETS - 1))};
+    }
+
+    std::uint64_t Stats::counter(Counter counter) const {
+        return counters[static_cast<std::size_t>(counter)];
+    }
+
+    HistogramSnapshot const& Stats::timer(Timer timer) const {
+        return timers[static_cast<std::size_t>(timer)];
+    }
+
+    char const* name(Counter counter) {
+        return COUNTER_NAMES[static_cast<std::size_t>(counter)].data();
+    }
+
+    char const* name(Timer timer) {
+        return TIMER_NAMES[static_cast<std::size_t>(timer)].data();
+    }
+
+    void add(Counter counter, std::uint64_t value) {
+        bump(local_block().counters[static_cast<std::size_t>(counter)], value);
+    }
+
+    void record_ticks(Timer timer, std::uint64_t start, std::uint64_t end) {
+        // A thread moved to another core may read a slightly earlier TSC
+        auto const elapsed = end > start ? end - start : 0;
+        record(timer, std::chrono::nanoseconds{
+                          static_cast<std::int64_t>(static_cast<double>(elapsed) * nanoseconds_per_tick())});
+    }
+
+    void record(Timer timer, std::chrono::nanoseconds elapsed) {
+        auto const nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(elapsed.count(), 0));
+
+        auto& slots = local_block().timers[static_cast<std::size_t>(timer)];
+        bump(slots.count, 1);
+        bump(slots.sum_ns, nanoseconds);
+        bump(slots.buckets[bucket_index(nanoseconds)], 1);
+    }
+
+    Stats stats() {
+        return registry().collect();
+    }
+
+    std::string to_prometheus(Stats const& stats) {
+        std::string text;
+        text.reserve(4096);
+        auto out = std::back_inserter(text);
+
+        for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+            fmt::format_to(out, "# TYPE fachory_{0}_total counter\nfachory_{0}_total {1}\n", COUNTER_NAMES[i],
+                stats.counters[i]);
+        }
+
+        for (std::size_t i = 0; i < TIMER_COUNT; ++i) {
+            auto const& timer = stats.timers[i];
+            auto const name   = TIMER_NAMES[i];
+            fmt::format_to(out, "# TYPE fachory_{}_seconds histogram\n", name);
+
+            // A fine bucket counts towards every edge it starts below
+            std::size_t index        = 0;
+            std::uint64_t cumulative = 0;
+            for (auto const edge : PROMETHEUS_BUCKETS) {
+                while (index < HISTOGRAM_BUCKETS && bucket_lower_bound(index) < edge) {
+                    cumulative += timer.buckets[index++];
+                }
+
+                fmt::format_to(out, "fachory_{}_seconds_bucket{{le=\"{}\"}} {}\n", name,
+                    static_cast<double>(edge) / 1e9, cumulative);
+            }
+
+            fmt::format_to(out, "fachory_{0}_seconds_bucket{{le=\"+Inf\"}} {1}\nfachory_{0}_seconds_sum {2}\n"
+                                "fachory_{0}_seconds_count {1}\n",
+                name, timer.count, static_cast<double>(timer.sum_ns) / 1e9);
+        }
+
+        return text;
+    }
+} // namespace fachory::metrics
@@ -0,0 +1,275 @@
+#include <metrics/trace.hpp>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace fachory::metrics {
+
+    namespace {
+
+        // Timestamps in the trace count from here
+        auto const EPOCH = std::chrono::steady_clock::now();
+
+        // A sequence of 0 marks a slot being written. A reader keeps a slot
+        // only when its sequence was the same before and after copying it;
+        // fields are stored with release and loaded with acquire, so a reader
+        // that copied a newer field also sees the newer sequence.
+        struct Slot {
+            std::atomic<std::uint64_t> sequence{0};
+            std::atomic<char const*> name{nullptr};
+            std::atomic<std::int64_t> start_ns{0};
+            std::atomic<std::int64_t> duration_ns{0};
+        };
+
+        // Written by its own thread only, read by anyone writing a trace
+        struct Ring {
+            std::uint32_t thread_id = 0;
+            std::atomic<std::uint64_t> next{0};
+            std::array<Slot, TRACE_CAPACITY> slots;
+        };
+
+        struct Span {
+            char const* name;
+            std::int64_t start_ns;
+            std::int64_t duration_ns;
+        };
+
+        void push(Ring& ring, Span const& span) {
+            auto const position = ring.next.load(std::memory_order_relaxed);
+            auto& slot          = ring.slots[position % TRACE_CAPACITY];
+
+            slot.sequence.store(0, std::memory_order_relaxed);
+            slot.name.store(span.name, std::memory_order_release);
+            slot.start_ns.store(span.start_ns, std::memory_order_release);
+            slot.duration_ns.store(span.duration_ns, std::memory_order_release);
+            slot.sequence.store(position + 1, std::memory_order_release);
+
+            ring.next.store(position + 1, std::memory_order_relaxed);
+        }
+
+        void copy_spans(Ring const& ring, std::vector<Span>& spans) {
+            for (auto const& slot : ring.slots) {
+                auto const before = slot.sequence.load(std::memory_order_acquire);
+                if (before == 0) {
+                    continue;
+                }
+
+                Span const span{
+                    .name        = slot.name.load(std::memory_order_acquire),
+                    .start_ns    = slot.start_ns.load(std::memory_order_acquire),
+                    .duration_ns = slot.duration_ns.load(std::memory_order_acquire),
+                };
+
+                if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                    spans.push_back(span);
+                }
+            }
+        }
+
+        class TraceRegistry {
+        public:
+            std::shared_ptr<Ring> attach() {
+                auto ring = std::make_shared<Ring>();
+
+                std::scoped_lock lock{_mutex};
+                ring->thread_id = ++_last_thread_id;
+                _rings.push_back(ring);
+                return ring;
+            }
+
+            // The spans of an exited thread are often the interesting ones
+            void detach(std::shared_ptr<Ring> const& ring) {
+                std::scoped_lock lock{_mutex};
+                std::erase(_rings, ring);
+                _retired.push_back(ring);
+                if (_retired.size() > MAX_RETIRED_TRACES) {
+                    _retired.pop_front();
+                }
+            }
+
+            std::vector<std::shared_ptr<Ring>> rings() {
+                std::scoped_lock lock{_mutex};
+                std::vector<std::shared_ptr<Ring>> all{begin(_retired), end(_retired)};
+                all.insert(end(all), begin(_rings), end(_rings));
+                return all;
+            }
+
+        private:
+            std::mutex _mutex;
+            std::vector<std::shared_ptr<Ring>> _rings;
+            std::deque<std::shared_ptr<Ring>> _retired;
+            std::uint32_t _last_thread_id = 0;
+        };
+
+        // Never destroyed, threads may still exit after static destructors ran
+        TraceRegistry& registry() {
+            static auto* const instance = new TraceRegistry{};
+            return *instance;
+        }
+
+        struct ThreadRing {
+            std::shared_ptr<Ring> ring;
+
+            ~ThreadRing() {
+                if (ring) {
+                    registry().detach(ring);
+                }
+            }
+        };
+
+        thread_local ThreadRing thread_ring;
+
+        Ring& local_ring() {
+            auto& ring = thread_ring.ring;
+            if (!ring) {
+                ring = registry().attach();
+            }
+
+            return *ring;
+        }
+
+        // Written by the signal handler, read by the dumper thread
+        std::atomic<int> signal_wake_fd{-1};
+        static_assert(std::atomic<int>::is_always_lock_free);
+
+        void wake_dumper(int) {
+            auto const saved_errno = errno;
+            auto const fd          = signal_wake_fd.load(std::memory_order_relaxed);
+            if (fd >= 0) {
+                char const byte = 1;
+                (void)::write(fd, &byte, 1);
+            }
+            errno = saved_errno;
+        }
+
+    } // namespace
+
+    void record_span(
+        char const* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        push(local_ring(), Span{
+                               .name        = name,
+                               .start_ns    = std::chrono::nanoseconds{start - EPOCH}.count(),
+                               .duration_ns = std::chrono::nanoseconds{end - start}.count(),
+                           });
+    }
+
+    bool write_chrome_trace(std::filesystem::path const& path) {
+        std::string text = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        auto out         = std::back_inserter(text);
+        auto const pid   = ::getpid();
+
+        std::vector<Span> spans;
+        spans.reserve(TRACE_CAPACITY);
+
+        auto first = true;
+        for (auto const& ring : registry().rings()) {
+            spans.clear();
+            copy_spans(*ring, spans);
+
+            for (auto const& span : spans) {
+                // Chrome wants microseconds, the fraction keeps nanoseconds
+                fmt::format_to(out,
+                    "{}{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                    first ? "\n" : ",\n", span.name, static_cast<double>(span.start_ns) / 1e3,
+                    static_cast<double>(span.duration_ns) / 1e3, pid, ring->thread_id);
+                first = false;
+            }
+        }
+        text += "\n]}\n";
+
+        auto temp_path = path;
+        temp_path += ".tmp";
+
+        {
+            std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+            file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            if (!file) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        return !error;
+    }
+
+    TraceDumper::TraceDumper(std::filesystem::path path, int signal)
+        : _path{std::move(path)}, _signal{signal}, _wake_fds{-1, -1}, _previous{} {
+        if (::pipe2(_wake_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+            spdlog::error("could not create the trace dump pipe: {}", std::strerror(errno));
+            return;
+        }
+        signal_wake_fd.store(_wake_fds[1], std::memory_order_relaxed);
+
+        struct sigaction action{};
+        action.sa_handler = wake_dumper;
+        action.sa_flags   = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (::sigaction(_signal, &action, &_previous) != 0) {
+            spdlog::error("could not install the trace dump handler: {}", std::strerror(errno));
+        }
+
+        _dumper = std::jthread{[this](std::stop_token stop) { run(std::move(stop)); }};
+    }
+
+    TraceDumper::~TraceDumper() {
+        if (_dumper.joinable()) {
+            _dumper.request_stop();
+            _dumper.join();
+            ::sigaction(_signal, &_previous, nullptr);
+        }
+
+        signal_wake_fd.store(-1, std::memory_order_relaxed);
+        for (auto const fd : _wake_fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    bool TraceDumper::dump() {
+        if (!write_chrome_trace(_path)) {
+            spdlog::warn("could not write the trace to {}", _path.string());
+            return false;
+        }
+
+        spdlog::info("wrote the trace to {}", _path.string());
+        return true;
+    }
+
+    void TraceDumper::run(std::stop_token stop) {
+        // Polled with a timeout so a stop request is seen without a signal
+        constexpr int POLL_INTERVAL_MS = 200;
+
+        pollfd wake{.fd = _wake_fds[0], .events = POLLIN, .revents = 0};
+        while (!stop.stop_requested()) {
+            if (::poll(&wake, 1, POLL_INTERVAL_MS) <= 0) {
+                continue;
+            }
+
+            // Signals that arrived while draining are covered by one dump
+            std::array<char, 64> drained;
+            while (::read(wake.fd, drained.data(), drained.size()) > 0) {}
+
+            dump();
+        }
+    }
+} // namespace fachory::metrics
@@ -0,0 +1,113 @@
+#include <printer/connection_pool.hpp>
+
+#include <cups/cups.h>
+#include <cups/http.h>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <utility>
+
+ConnectionLease::ConnectionLease(ConnectionPool* pool, std::string printer_name, http_t* http)
+    : _pool{pool}, _printer_name{std::move(printer_name)}, _http{http} {}
+
+ConnectionLease::~ConnectionLease() {
+    release();
+}
+
+ConnectionLease::ConnectionLease(ConnectionLease&& other) noexcept
+    : _pool{other._pool}, _printer_name{std::move(other._printer_name)}, _http{std::exchange(other._http, nullptr)} {}
+
+ConnectionLease& ConnectionLease::operator=(ConnectionLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        _pool         = other._pool;
+        _printer_name = std::move(other._printer_name);
+        _http         = std::exchange(other._http, nullptr);
+    }
+
+    return *this;
+}
+
+http_t* ConnectionLease::get() const {
+    return _http;
+}
+
+void ConnectionLease::discard() {
+    if (_http) {
+        httpClose(_http);
+        _http = nullptr;
+    }
+}
+
+void ConnectionLease::release() {
+    if (_http && _pool) {
+        _pool->give_back(_printer_name, std::exchange(_http, nullptr));
+    }
+}
+
+ConnectionPool::ConnectionPool(std::size_t max_idle_per_printer)
+    : _max_idle{max_idle_per_printer}, _idle{} {}
+
+ConnectionPool::~ConnectionPool() {
+    for (auto& [name, connections] : _idle) {
+        for (auto* http : connections) {
+            httpClose(http);
+        }
+    }
+}
+
+std::optional<ConnectionLease> ConnectionPool::acquire(std::string const& printer_name, cups_dest_t* dest) {
+    {
+        std::scoped_lock lock{_mutex};
+        auto found = _idle.find(printer_name);
+        if (found != end(_idle) && !found->second.empty()) {
+            auto* http = found->second.back();
+            found->second.pop_back();
+            return std::make_optional<ConnectionLease>(this, printer_name, http);
+        }
+    }
+
+    // Connecting can take a while, so it happens outside the lock
+    std::array<char, 1024> resource{};
+    auto* http = cupsConnectDest(
+        dest, CUPS_DEST_FLAGS_NONE, CONNECT_TIMEOUT_MS, nullptr, resource.data(), resource.size(), nullptr, nullptr);
+
+    if (!http) {
+        spdlog::error("could not connect to printer {}: {}", printer_name, cupsLastErrorString());
+        return std::nullopt;
+    }
+
+    spdlog::info("opened connection to printer {}", printer_name);
+    return std::make_optional<ConnectionLease>(this, printer_name, http);
+}
+
+void ConnectionPool::evict(std::string const& printer_name) {
+    std::vector<http_t*> evicted;
+    {
+        std::scoped_lock lock{_mutex};
+        auto found = _idle.find(printer_name);
+        if (found == end(_idle)) {
+            return;
+        }
+
+        evicted = std::move(found->second);
+        _idle.erase(found);
+    }
+
+    for (auto* http : evicted) {
+        httpClose(http);
+    }
+}
+
+void ConnectionPool::give_back(std::string const& printer_name, http_t* http) {
+    {
+        std::scoped_lock lock{_mutex};
+        auto& connections = _idle[printer_name];
+        if (connections.size() < _max_idle) {
+            connections.push_back(http);
+            return;
+        }
+    }
+
+    httpClose(http);
+}
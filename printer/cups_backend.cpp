@@ -0,0 +1,369 @@
+#include <printer/cups_backend.hpp>
+
+#include <cups/cups.h>
+#include <cups/http.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+    using PrinterOptionBuffer = std::unique_ptr<cups_option_t, std::function<void(cups_option_t*)>>;
+    using PrinterOptions      = std::pair<PrinterOptionBuffer, std::shared_ptr<int>>;
+
+    // Errors that aren't from a CUPS call, which cupsLastErrorString can't
+    // know about. Per thread like it, and cleared by the next create_job.
+    thread_local std::string backend_error;
+
+    // A destination and its info
+    struct CupsPrinter final : PrinterHandle {
+        std::shared_ptr<cups_dest_t> dest;
+        std::shared_ptr<cups_dinfo_t> info;
+    };
+
+    // Longest a single cupsEnumDests call runs during discovery
+    constexpr std::chrono::milliseconds DISCOVERY_SLICE{200};
+
+    // Destinations seen during one discovery pass, by name
+    using DiscoveredDestinations = std::map<std::string, std::shared_ptr<cups_dest_t>>;
+
+    std::shared_ptr<cups_dest_t> copy_destination(cups_dest_t* dest) {
+        cups_dest_t* copy = nullptr;
+        if (cupsCopyDest(dest, 0, &copy) != 1 || !copy) {
+            return nullptr;
+        }
+
+        return std::shared_ptr<cups_dest_t>{copy, [](cups_dest_t* ptr) { cupsFreeDests(1, ptr); }};
+    }
+
+    int printer_register_cp(void* user_data, unsigned flags, cups_dest_t* dest) {
+        if (!dest) {
+            return 1;
+        }
+
+        auto discovered = static_cast<DiscoveredDestinations*>(user_data);
+
+        if (flags & CUPS_DEST_FLAGS_REMOVED) {
+            discovered->erase(dest->name);
+            return 1;
+        }
+
+        if (auto copy = copy_destination(dest)) {
+            (*discovered)[dest->name] = std::move(copy);
+        }
+        return 1;
+    }
+
+    void free_dest_info(cups_dinfo_t* info) {
+        if (info) {
+            cupsFreeDestInfo(info);
+        }
+    }
+
+    PrinterEntry make_printer_entry(std::shared_ptr<cups_dest_t> dest) {
+        PrinterDetails details{.name = dest->name,
+         .instance                   = dest->instance != nullptr ? dest->instance : "",
+         .is_default                 = static_cast<bool>(dest->is_default),
+         .options                    = {}};
+
+        auto printer  = std::make_shared<CupsPrinter>();
+        printer->info = std::shared_ptr<cups_dinfo_t>{cupsCopyDestInfo(CUPS_HTTP_DEFAULT, dest.get()), free_dest_info};
+        printer->dest = std::move(dest);
+
+        return PrinterEntry{.details = std::move(details), .handle = std::move(printer)};
+    }
+
+    PrinterOptions make_default_options() {
+        int num_options        = 0;
+        cups_option_t* options = NULL;
+
+        // Gets all options (thermal printer related)
+        num_options = cupsAddOption(CUPS_MEDIA, CUPS_MEDIA_LETTER, num_options, &options);
+        num_options = cupsAddOption(CUPS_SIDES, CUPS_SIDES_ONE_SIDED, num_options, &options);
+        num_options = cupsAddOption("media", "Roll80mm", num_options, &options);
+        num_options = cupsAddOption("orientation-requested", "3", num_options, &options);
+
+        auto const options_size = std::make_shared<int>(num_options);
+        PrinterOptionBuffer options_buffer{
+         options, [options_size](auto* ptr) { cupsFreeOptions(*options_size, ptr); }};
+
+        return {std::move(options_buffer), options_size};
+    }
+
+    std::chrono::system_clock::time_point to_time_point(time_t time) {
+        return time == 0 ? std::chrono::system_clock::time_point{} : std::chrono::system_clock::from_time_t(time);
+    }
+
+    // Filled in attribute by attribute while reading a Get-Jobs response
+    constexpr FinishedJob UNREAD_JOB{
+        .job_id = 0, .state = JobState::Unknown, .created = {}, .processing = {}, .completed = {}};
+
+    JobState to_job_state(ipp_jstate_t state) {
+        switch (state) {
+        case IPP_JSTATE_COMPLETED:
+            return JobState::Completed;
+        case IPP_JSTATE_CANCELED:
+            return JobState::Canceled;
+        case IPP_JSTATE_ABORTED:
+            return JobState::Aborted;
+        default:
+            return JobState::Unknown;
+        }
+    }
+
+    // An already created CUPS job and the connection it was created on.
+    // Keeps the printer alive for as long as the job runs.
+    class CupsJob final : public BackendJob {
+    public:
+        CupsJob(std::string printer_name, int job_id, ConnectionLease connection,
+            std::shared_ptr<CupsPrinter const> printer, PrinterOptions options)
+            : _printer_name{std::move(printer_name)}, _job_id{job_id}, _last{false}, _finished{false},
+              _cancelled{false}, _connection{std::move(connection)}, _printer{std::move(printer)},
+              _options{std::move(options)} {}
+
+        ~CupsJob() override {
+            if (_cancelled) {
+                cupsCancelDestJob(_connection.get(), _printer->dest.get(), _job_id);
+
+                // The connection may be half way through a request, don't reuse it
+                _connection.discard();
+                return;
+            }
+
+            if (!_finished) {
+                (void)finish_document();
+            }
+        }
+
+        CupsJob(CupsJob const&)            = delete;
+        CupsJob& operator=(CupsJob const&) = delete;
+
+        [[nodiscard]] int id() const override {
+            return _job_id;
+        }
+
+        [[nodiscard]] bool start_document(std::string const& name, std::string const& format, bool last) override {
+            _last             = last;
+            auto const status = cupsStartDestDocument(_connection.get(), _printer->dest.get(), _printer->info.get(),
+                _job_id, name.c_str(), format.c_str(), *_options.second, _options.first.get(), last ? 1 : 0);
+
+            return status == HTTP_STATUS_CONTINUE;
+        }
+
+        [[nodiscard]] bool write(std::span<char const> data) override {
+            return cupsWriteRequestData(_connection.get(), data.data(), data.size()) == HTTP_STATUS_CONTINUE;
+        }
+
+        bool finish_document() override {
+            // Finishing the last document closes the job, whatever CUPS answers
+            _finished = _last;
+
+            if (cupsFinishDestDocument(_connection.get(), _printer->dest.get(), _printer->info.get())
+                != IPP_STATUS_OK) {
+                spdlog::error("job {} failed for printer {}", _job_id, _printer_name);
+                _connection.discard();
+                return false;
+            }
+
+            if (_finished) {
+                spdlog::info("job {} succeeded for printer {}", _job_id, _printer_name);
+            }
+
+            return true;
+        }
+
+        void cancel() override {
+            _cancelled = true;
+        }
+
+    private:
+        std::string _printer_name;
+        int _job_id;
+        bool _last;
+        bool _finished;
+        bool _cancelled;
+        ConnectionLease _connection;
+        std::shared_ptr<CupsPrinter const> _printer;
+        PrinterOptions _options;
+    };
+
+} // namespace
+
+CupsBackend::CupsBackend(std::size_t max_idle_connections) : _connections{max_idle_connections} {}
+
+std::optional<PrinterEntry> CupsBackend::make_entry(cups_dest_t* dest) {
+    if (!dest) {
+        return std::nullopt;
+    }
+
+    auto copy = copy_destination(dest);
+    if (!copy) {
+        return std::nullopt;
+    }
+
+    return make_printer_entry(std::move(copy));
+}
+
+std::optional<std::vector<PrinterEntry>> CupsBackend::discover(
+    std::chrono::milliseconds timeout, std::stop_token stop, PrinterSnapshot const& known) {
+    // cupsEnumDests only polls a plain int to cancel, which can't be set
+    // from another thread without a race. Enumerating in short slices and
+    // checking stop between them keeps a stop request from waiting for the
+    // whole timeout; destinations found in every slice add up.
+    auto const deadline = std::chrono::steady_clock::now() + timeout;
+
+    DiscoveredDestinations discovered;
+    for (;;) {
+        if (stop.stop_requested()) {
+            return std::nullopt;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        auto const slice = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(deadline - start),
+            std::chrono::milliseconds{0}, DISCOVERY_SLICE);
+        cupsEnumDests(CUPS_DEST_FLAGS_NONE, static_cast<int>(slice.count()), nullptr, 0, 0, printer_register_cp,
+            &discovered);
+
+        // Returning before the slice ran out means there was nothing left
+        // to browse for
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= deadline || now < start + slice) {
+            break;
+        }
+    }
+
+    if (stop.stop_requested()) {
+        return std::nullopt;
+    }
+
+    // Printers we already know keep their entry, and with it their info
+    std::vector<PrinterEntry> printers;
+    printers.reserve(discovered.size());
+    for (auto& [name, dest] : discovered) {
+        if (auto const* entry = known.find(name)) {
+            printers.push_back(*entry);
+            continue;
+        }
+
+        printers.push_back(make_printer_entry(std::move(dest)));
+    }
+
+    return printers;
+}
+
+std::unique_ptr<BackendJob> CupsBackend::create_job(PrinterEntry const& printer, std::string const& title) {
+    auto const& printer_name = printer.details.name;
+
+    backend_error.clear();
+
+    // Entries added by hand may come from another backend
+    auto cups_printer = std::dynamic_pointer_cast<CupsPrinter const>(printer.handle);
+    if (!cups_printer) {
+        backend_error = fmt::format("printer {} was not created by the CUPS backend", printer_name);
+        return nullptr;
+    }
+
+    if (!cups_printer->info) {
+        backend_error = fmt::format("could not find info for printer {}", printer_name);
+        return nullptr;
+    }
+
+    auto* dest = cups_printer->dest.get();
+    auto* info = cups_printer->info.get();
+
+    auto maybe_connection = _connections.acquire(printer_name, dest);
+    if (!maybe_connection) {
+        return nullptr;
+    }
+
+    auto options       = make_default_options();
+    int job_id         = 0;
+    auto const job_res = cupsCreateDestJob(
+        maybe_connection->get(), dest, info, &job_id, title.c_str(), *options.second, options.first.get());
+
+    if (job_res != IPP_STATUS_OK) {
+        maybe_connection->discard();
+        return nullptr;
+    }
+
+    return std::make_unique<CupsJob>(
+        printer_name, job_id, std::move(*maybe_connection), std::move(cups_printer), std::move(options));
+}
+
+void CupsBackend::forget(std::string const& printer_name) {
+    _connections.evict(printer_name);
+}
+
+std::optional<std::vector<FinishedJob>> CupsBackend::finished_jobs(std::string const& printer_name, int first_job_id) {
+    // cupsGetJobs2 always lists the whole history, so this is the Get-Jobs
+    // request it sends, narrowed down to our own jobs from first_job_id on
+    static constexpr std::array<char const*, 5> ATTRIBUTES{
+        "job-id", "job-state", "time-at-creation", "time-at-processing", "time-at-completed"};
+
+    std::array<char, HTTP_MAX_URI> uri;
+    httpAssembleURIf(HTTP_URI_CODING_ALL, uri.data(), static_cast<int>(uri.size()), "ipp", nullptr, "localhost", 0,
+        "/printers/%s", printer_name.c_str());
+
+    auto* request = ippNewRequest(IPP_OP_GET_JOBS);
+    ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_URI, "printer-uri", nullptr, uri.data());
+    ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME, "requesting-user-name", nullptr, cupsUser());
+    ippAddBoolean(request, IPP_TAG_OPERATION, "my-jobs", 1);
+    ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "which-jobs", nullptr, "completed");
+    ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "first-job-id", first_job_id);
+    ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "requested-attributes",
+        static_cast<int>(ATTRIBUTES.size()), nullptr, ATTRIBUTES.data());
+
+    // cupsDoRequest frees the request
+    auto const response = std::unique_ptr<ipp_t, decltype(&ippDelete)>{
+        cupsDoRequest(CUPS_HTTP_DEFAULT, request, "/"), ippDelete};
+    if (!response || cupsLastError() > IPP_STATUS_OK_CONFLICTING) {
+        return std::nullopt;
+    }
+
+    // Every job is a run of job attributes, runs are split by separators
+    std::vector<FinishedJob> finished;
+    auto job = UNREAD_JOB;
+    auto const end_job = [&finished, &job] {
+        if (job.job_id > 0) {
+            finished.push_back(job);
+        }
+        job = UNREAD_JOB;
+    };
+
+    for (auto* attribute = ippFirstAttribute(response.get()); attribute; attribute = ippNextAttribute(response.get())) {
+        if (ippGetGroupTag(attribute) != IPP_TAG_JOB || !ippGetName(attribute)) {
+            end_job();
+            continue;
+        }
+
+        std::string_view const name = ippGetName(attribute);
+        auto const value            = ippGetInteger(attribute, 0);
+        if (name == "job-id") {
+            job.job_id = value;
+        } else if (name == "job-state") {
+            job.state = to_job_state(static_cast<ipp_jstate_t>(value));
+        } else if (name == "time-at-creation") {
+            job.created = to_time_point(value);
+        } else if (name == "time-at-processing") {
+            job.processing = to_time_point(value);
+        } else if (name == "time-at-completed") {
+            job.completed = to_time_point(value);
+        }
+    }
+    end_job();
+
+    return finished;
+}
+
+std::string CupsBackend::last_error() const {
+    return backend_error.empty() ? cupsLastErrorString() : backend_error;
+}
@@ -0,0 +1,210 @@
+#include <printer/escpos.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+    template <typename... Bytes>
+    constexpr std::array<std::byte, sizeof...(Bytes)> command(Bytes... bytes) {
+        return {static_cast<std::byte>(bytes)...};
+    }
+
+    constexpr auto INITIALIZE = command(0x1B, 0x40);
+
+    // Tables are indexed by the enabled flag or the enum value
+    constexpr std::array BOLD      = {command(0x1B, 0x45, 0x00), command(0x1B, 0x45, 0x01)};
+    constexpr std::array UNDERLINE = {command(0x1B, 0x2D, 0x00), command(0x1B, 0x2D, 0x01)};
+    constexpr std::array ALIGNMENT = {command(0x1B, 0x61, 0x00), command(0x1B, 0x61, 0x01), command(0x1B, 0x61, 0x02)};
+    constexpr std::array CUT       = {command(0x1D, 0x56, 0x41, 0x00), command(0x1D, 0x56, 0x42, 0x00)};
+
+    // Commands followed by a single parameter byte
+    constexpr auto CHARACTER_SIZE = command(0x1D, 0x21);
+    constexpr auto FEED_LINES     = command(0x1B, 0x64);
+
+    constexpr auto BARCODE_HEIGHT    = command(0x1D, 0x68);
+    constexpr auto BARCODE_WIDTH     = command(0x1D, 0x77);
+    constexpr auto BARCODE_HRI_BELOW = command(0x1D, 0x48, 0x02);
+    constexpr auto BARCODE_PRINT     = command(0x1D, 0x6B);
+
+    constexpr auto QR_MODEL_2     = command(0x1D, 0x28, 0x6B, 0x04, 0x00, 0x31, 0x41, 0x32, 0x00);
+    constexpr auto QR_MODULE_SIZE = command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x43);
+    constexpr std::array QR_ERROR = {
+     command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x45, 0x30),
+     command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x45, 0x31),
+     command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x45, 0x32),
+     command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x45, 0x33),
+    };
+    constexpr auto QR_STORE_HEADER = command(0x1D, 0x28, 0x6B);
+    constexpr auto QR_STORE_FIELDS = command(0x31, 0x50, 0x30);
+    constexpr auto QR_PRINT        = command(0x1D, 0x28, 0x6B, 0x03, 0x00, 0x31, 0x51, 0x30);
+
+    // GS v 0, normal density, followed by the width in bytes and the height
+    constexpr auto RASTER_IMAGE = command(0x1D, 0x76, 0x30, 0x00);
+
+    constexpr std::size_t MAX_BARCODE_LENGTH = 255;
+    constexpr std::size_t MAX_QR_LENGTH      = 7089;
+    constexpr std::size_t MAX_RASTER_BYTES   = 0xFFFF;
+    constexpr std::size_t RASTER_BAND_ROWS   = 256;
+    constexpr std::uint8_t LINE_FEED         = 0x0A;
+
+} // namespace
+
+EscPosDocument::EscPosDocument(std::size_t capacity)
+    : _buffer{} {
+    _buffer.reserve(capacity);
+    append(INITIALIZE);
+}
+
+EscPosDocument& EscPosDocument::text(std::string_view text) {
+    append(text);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::line(std::string_view text) {
+    append(text);
+    append(LINE_FEED);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::bold(bool enabled) {
+    append(BOLD[enabled ? 1 : 0]);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::underline(bool enabled) {
+    append(UNDERLINE[enabled ? 1 : 0]);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::size(std::uint8_t width, std::uint8_t height) {
+    if (width < 1 || width > 8 || height < 1 || height > 8) {
+        spdlog::error("invalid character size {}x{}, skipping", width, height);
+        return *this;
+    }
+
+    append(CHARACTER_SIZE);
+    append(static_cast<std::uint8_t>(((width - 1) << 4) | (height - 1)));
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::align(Alignment alignment) {
+    append(ALIGNMENT[static_cast<std::size_t>(alignment)]);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::feed(std::uint8_t lines) {
+    append(FEED_LINES);
+    append(lines);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::cut(CutMode mode) {
+    append(CUT[static_cast<std::size_t>(mode)]);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::barcode(
+    BarcodeType type, std::string_view data, std::uint8_t height, std::uint8_t width) {
+    if (data.empty() || data.size() > MAX_BARCODE_LENGTH) {
+        spdlog::error("invalid barcode length {}, skipping", data.size());
+        return *this;
+    }
+
+    append(BARCODE_HEIGHT);
+    append(height);
+    append(BARCODE_WIDTH);
+    append(width);
+    append(BARCODE_HRI_BELOW);
+    append(BARCODE_PRINT);
+    append(static_cast<std::uint8_t>(type));
+    append(static_cast<std::uint8_t>(data.size()));
+    append(data);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::qr_code(
+    std::string_view data, std::uint8_t module_size, QrErrorCorrection correction) {
+    if (data.empty() || data.size() > MAX_QR_LENGTH) {
+        spdlog::error("invalid qr code length {}, skipping", data.size());
+        return *this;
+    }
+
+    if (module_size < 1 || module_size > 16) {
+        spdlog::error("invalid qr code module size {}, skipping", module_size);
+        return *this;
+    }
+
+    // The stored length also counts the three function bytes
+    auto const stored_length = data.size() + QR_STORE_FIELDS.size();
+
+    append(QR_MODEL_2);
+    append(QR_MODULE_SIZE);
+    append(module_size);
+    append(QR_ERROR[static_cast<std::size_t>(correction)]);
+    append(QR_STORE_HEADER);
+    append(static_cast<std::uint8_t>(stored_length & 0xFF));
+    append(static_cast<std::uint8_t>(stored_length >> 8));
+    append(QR_STORE_FIELDS);
+    append(data);
+    append(QR_PRINT);
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::raster_image(RasterImage const& image) {
+    auto const row_bytes = image.bytes_per_row();
+    if (row_bytes == 0 || row_bytes > MAX_RASTER_BYTES || image.bits.size() != row_bytes * image.height) {
+        spdlog::error("invalid raster image {}x{}, skipping", image.width, image.height);
+        return *this;
+    }
+
+    _buffer.reserve(_buffer.size() + image.bits.size()
+                    + (image.height / RASTER_BAND_ROWS + 1) * (RASTER_IMAGE.size() + 4));
+
+    for (std::size_t row = 0; row < image.height; row += RASTER_BAND_ROWS) {
+        auto const rows = std::min(RASTER_BAND_ROWS, image.height - row);
+
+        append(RASTER_IMAGE);
+        append(static_cast<std::uint8_t>(row_bytes & 0xFF));
+        append(static_cast<std::uint8_t>(row_bytes >> 8));
+        append(static_cast<std::uint8_t>(rows & 0xFF));
+        append(static_cast<std::uint8_t>(rows >> 8));
+        append(std::as_bytes(std::span{image.bits}.subspan(row * row_bytes, rows * row_bytes)));
+    }
+
+    return *this;
+}
+
+EscPosDocument& EscPosDocument::reset() {
+    append(INITIALIZE);
+    return *this;
+}
+
+void EscPosDocument::clear() {
+    _buffer.clear();
+    append(INITIALIZE);
+}
+
+std::span<std::byte const> EscPosDocument::bytes() const {
+    return _buffer;
+}
+
+std::size_t EscPosDocument::size() const {
+    return _buffer.size();
+}
+
+void EscPosDocument::append(std::span<std::byte const> bytes) {
+    _buffer.insert(end(_buffer), begin(bytes), end(bytes));
+}
+
+void EscPosDocument::append(std::string_view text) {
+    append(std::as_bytes(std::span{text}));
+}
+
+void EscPosDocument::append(std::uint8_t byte) {
+    _buffer.push_back(static_cast<std::byte>(byte));
+}
@@ -0,0 +1,73 @@
+#ifndef PRINTER_CONNECTION_POOL_H
+#define PRINTER_CONNECTION_POOL_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern "C" {
+typedef struct _http_s http_t;
+typedef struct cups_dest_s cups_dest_t;
+}
+
+class ConnectionPool;
+
+// Borrowed connection to a single destination. Goes back to the pool when
+// destroyed, unless it was discarded because its state can't be trusted.
+class ConnectionLease {
+public:
+    ConnectionLease(ConnectionPool* pool, std::string printer_name, http_t* http);
+    ~ConnectionLease();
+
+    ConnectionLease(ConnectionLease&& other) noexcept;
+    ConnectionLease& operator=(ConnectionLease&& other) noexcept;
+    ConnectionLease(ConnectionLease const&)            = delete;
+    ConnectionLease& operator=(ConnectionLease const&) = delete;
+
+    [[nodiscard]] http_t* get() const;
+
+    // Closes the connection instead of returning it to the pool
+    void discard();
+
+private:
+    ConnectionPool* _pool;
+    std::string _printer_name;
+    http_t* _http;
+
+    void release();
+};
+
+// Keeps persistent http_t connections per destination (opened with
+// cupsConnectDest) so consecutive jobs skip the connection setup and
+// printers never share a connection.
+class ConnectionPool {
+public:
+    static constexpr std::size_t DEFAULT_MAX_IDLE = 2;
+    static constexpr int CONNECT_TIMEOUT_MS       = 5000;
+
+    explicit ConnectionPool(std::size_t max_idle_per_printer = DEFAULT_MAX_IDLE);
+    ~ConnectionPool();
+
+    ConnectionPool(ConnectionPool const&)            = delete;
+    ConnectionPool& operator=(ConnectionPool const&) = delete;
+
+    [[nodiscard]] std::optional<ConnectionLease> acquire(std::string const& printer_name, cups_dest_t* dest);
+
+    // Closes every idle connection kept for the printer
+    void evict(std::string const& printer_name);
+
+private:
+    friend class ConnectionLease;
+
+    std::size_t _max_idle;
+    std::mutex _mutex;
+    std::map<std::string, std::vector<http_t*>> _idle;
+
+    void give_back(std::string const& printer_name, http_t* http);
+};
+
+
+#endif // PRINTER_CONNECTION_POOL_H
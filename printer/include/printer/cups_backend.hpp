@@ -0,0 +1,42 @@
+#ifndef PRINTER_CUPS_BACKEND_H
+#define PRINTER_CUPS_BACKEND_H
+
+#include <printer/connection_pool.hpp>
+#include <printer/printer_backend.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+extern "C" {
+typedef struct cups_dest_s cups_dest_t;
+}
+
+// Prints through libcups. Jobs go over pooled per-printer connections, and
+// the destination info of a printer is only fetched when it is first seen.
+class CupsBackend final : public PrinterBackend {
+public:
+    explicit CupsBackend(std::size_t max_idle_connections = ConnectionPool::DEFAULT_MAX_IDLE);
+
+    // Copies the destination, std::nullopt if CUPS can't
+    [[nodiscard]] static std::optional<PrinterEntry> make_entry(cups_dest_t* dest);
+
+    [[nodiscard]] std::optional<std::vector<PrinterEntry>> discover(
+        std::chrono::milliseconds timeout, std::stop_token stop, PrinterSnapshot const& known) override;
+    [[nodiscard]] std::unique_ptr<BackendJob> create_job(
+        PrinterEntry const& printer, std::string const& title) override;
+    void forget(std::string const& printer_name) override;
+    [[nodiscard]] std::optional<std::vector<FinishedJob>> finished_jobs(
+        std::string const& printer_name, int first_job_id) override;
+    [[nodiscard]] std::string last_error() const override;
+
+private:
+    ConnectionPool _connections;
+};
+
+
+#endif // PRINTER_CUPS_BACKEND_H
@@ -0,0 +1,78 @@
+#ifndef PRINTER_ESCPOS_H
+#define PRINTER_ESCPOS_H
+
+#include <printer/raster.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+enum class Alignment : std::uint8_t { Left, Center, Right };
+
+enum class CutMode : std::uint8_t { Full, Partial };
+
+// Values are the GS k "function B" barcode system identifiers
+enum class BarcodeType : std::uint8_t {
+    UpcA    = 65,
+    UpcE    = 66,
+    Ean13   = 67,
+    Ean8    = 68,
+    Code39  = 69,
+    Itf     = 70,
+    Codabar = 71,
+    Code93  = 72,
+    Code128 = 73,
+};
+
+enum class QrErrorCorrection : std::uint8_t { Low, Medium, Quartile, High };
+
+// Builds an ESC/POS byte stream for thermal printers, to be sent as
+// CUPS_FORMAT_RAW. The printer reset (ESC @) is the first command of every
+// document, so no separate reset document is needed. Commands that can't
+// be encoded are logged and skipped.
+class EscPosDocument {
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+    explicit EscPosDocument(std::size_t capacity = DEFAULT_CAPACITY);
+
+    EscPosDocument& text(std::string_view text);
+    EscPosDocument& line(std::string_view text = {});
+
+    EscPosDocument& bold(bool enabled);
+    EscPosDocument& underline(bool enabled);
+
+    // Character magnification, 1 to 8 on each axis
+    EscPosDocument& size(std::uint8_t width, std::uint8_t height);
+    EscPosDocument& align(Alignment alignment);
+    EscPosDocument& feed(std::uint8_t lines);
+    EscPosDocument& cut(CutMode mode = CutMode::Partial);
+
+    EscPosDocument& barcode(BarcodeType type, std::string_view data, std::uint8_t height = 80, std::uint8_t width = 3);
+    EscPosDocument& qr_code(std::string_view data, std::uint8_t module_size = 6,
+        QrErrorCorrection correction = QrErrorCorrection::Medium);
+
+    // GS v 0 raster graphics, split in bands the printer can buffer
+    EscPosDocument& raster_image(RasterImage const& image);
+
+    // Inlines another ESC @, dropping any formatting set so far
+    EscPosDocument& reset();
+
+    // Starts a new document, keeping the allocated buffer around
+    void clear();
+
+    [[nodiscard]] std::span<std::byte const> bytes() const;
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    std::vector<std::byte> _buffer;
+
+    void append(std::span<std::byte const> bytes);
+    void append(std::string_view text);
+    void append(std::uint8_t byte);
+};
+
+
+#endif // PRINTER_ESCPOS_H
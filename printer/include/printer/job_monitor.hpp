@@ -0,0 +1,81 @@
+#ifndef PRINTER_JOB_MONITOR_H
+#define PRINTER_JOB_MONITOR_H
+
+#include <printer/printer_backend.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct JobCompletion {
+    std::string printer_name;
+    int job_id;
+    JobState state;
+
+    // As reported by the backend, left at the epoch for stages the job never reached
+    std::chrono::system_clock::time_point created;
+    std::chrono::system_clock::time_point processing;
+    std::chrono::system_clock::time_point completed;
+};
+
+// Tracks in-flight jobs on one background thread. Each poll asks the
+// backend for the finished jobs of every printer that has something in
+// flight, one request per printer however many jobs it has, starting at the
+// oldest job still watched on it.
+//
+// A job the backend never reports, e.g. one purged from its history while
+// the monitor wasn't looking, is resolved as JobState::Unknown once it was
+// watched for max_age.
+class JobMonitor {
+public:
+    using Callback = std::function<void(JobCompletion const& completion)>;
+
+    static constexpr std::chrono::milliseconds DEFAULT_POLL_INTERVAL{500};
+    static constexpr std::chrono::milliseconds DEFAULT_MAX_AGE = std::chrono::minutes{30};
+
+    // The backend has to outlive the monitor
+    explicit JobMonitor(PrinterBackend& backend, std::chrono::milliseconds poll_interval = DEFAULT_POLL_INTERVAL,
+        std::chrono::milliseconds max_age = DEFAULT_MAX_AGE);
+
+    // Jobs still watched are resolved as JobState::Unknown
+    ~JobMonitor();
+
+    JobMonitor(JobMonitor const&)            = delete;
+    JobMonitor& operator=(JobMonitor const&) = delete;
+
+    // The callback runs on the monitor thread, it should not block
+    void watch(std::string const& printer_name, int job_id, Callback callback);
+    [[nodiscard]] std::future<JobCompletion> watch(std::string const& printer_name, int job_id);
+
+    [[nodiscard]] std::size_t in_flight() const;
+
+private:
+    struct Watch {
+        int job_id;
+        std::chrono::steady_clock::time_point since;
+        Callback callback;
+    };
+
+    PrinterBackend& _backend;
+    std::chrono::milliseconds _poll_interval;
+    std::chrono::milliseconds _max_age;
+
+    mutable std::mutex _mutex;
+    std::condition_variable_any _wake;
+    std::map<std::string, std::vector<Watch>> _watched;
+
+    std::jthread _poller;
+
+    void run(std::stop_token stop);
+    void poll();
+};
+
+
+#endif // PRINTER_JOB_MONITOR_H
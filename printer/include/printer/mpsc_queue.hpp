@@ -0,0 +1,94 @@
+#ifndef PRINTER_MPSC_QUEUE_H
+#define PRINTER_MPSC_QUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free queue with many producers and a single consumer.
+// Every cell carries a sequence number that tells producers and the
+// consumer whose turn it is, so neither side ever takes a lock.
+template <typename T>
+class BoundedMpscQueue {
+public:
+    explicit BoundedMpscQueue(std::size_t capacity)
+        : _capacity{std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)}, _mask{_capacity - 1},
+          _cells{std::make_unique<Cell[]>(_capacity)} {
+        for (std::size_t i = 0; i < _capacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMpscQueue(BoundedMpscQueue const&)            = delete;
+    BoundedMpscQueue& operator=(BoundedMpscQueue const&) = delete;
+
+    // Safe to call from any thread. Returns false (leaving value untouched)
+    // when the queue is full.
+    [[nodiscard]] bool try_push(T& value) {
+        auto position = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell          = _cells[position & _mask];
+            auto const sequence = cell.sequence.load(std::memory_order_acquire);
+            auto const diff     = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value.emplace(std::move(value));
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Must only be called from the consumer thread.
+    [[nodiscard]] std::optional<T> try_pop() {
+        auto const position = _head.load(std::memory_order_relaxed);
+        auto& cell          = _cells[position & _mask];
+        auto const sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if (sequence != position + 1) {
+            return std::nullopt;
+        }
+
+        _head.store(position + 1, std::memory_order_relaxed);
+        std::optional<T> value{std::move(cell.value)};
+        cell.value.reset();
+        cell.sequence.store(position + _capacity, std::memory_order_release);
+        return value;
+    }
+
+    [[nodiscard]] std::size_t capacity() const {
+        return _capacity;
+    }
+
+    // Only a hint, producers may be mid-push while this is read.
+    [[nodiscard]] std::size_t size_approx() const {
+        auto const tail = _tail.load(std::memory_order_relaxed);
+        auto const head = _head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        std::optional<T> value;
+    };
+
+    std::size_t const _capacity;
+    std::size_t const _mask;
+    std::unique_ptr<Cell[]> _cells;
+
+    alignas(64) std::atomic<std::size_t> _tail{0};
+    alignas(64) std::atomic<std::size_t> _head{0};
+};
+
+
+#endif // PRINTER_MPSC_QUEUE_H
@@ -0,0 +1,114 @@
+#ifndef PRINTER_PAYLOAD_CACHE_H
+#define PRINTER_PAYLOAD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using PayloadKey    = std::uint64_t;
+using CachedPayload = std::shared_ptr<std::vector<std::byte> const>;
+
+// FNV-1a over everything that decides what the printer receives
+class PayloadHasher {
+public:
+    PayloadHasher& add(std::span<std::byte const> bytes);
+    PayloadHasher& add(std::string_view text);
+    PayloadHasher& add(std::uint64_t value);
+
+    [[nodiscard]] PayloadKey key() const;
+
+private:
+    std::uint64_t _state = 0xcbf29ce484222325ULL;
+};
+
+struct CacheStats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t spill_hits;
+    std::uint64_t evictions;
+    std::size_t entries;
+    std::size_t bytes;
+};
+
+// Printer-ready payloads keyed by PayloadKey, bounded by a memory budget
+// with least recently used eviction. When a spill directory is given,
+// evicted payloads are written there and read back on the next miss. The
+// directory has a budget of its own, the oldest files are deleted first.
+class PayloadCache {
+public:
+    static constexpr std::size_t DEFAULT_BUDGET       = 32 * 1024 * 1024;
+    static constexpr std::size_t DEFAULT_SPILL_BUDGET = 256 * 1024 * 1024;
+
+    explicit PayloadCache(std::size_t budget_bytes = DEFAULT_BUDGET,
+        std::optional<std::filesystem::path> spill_directory = std::nullopt,
+        std::size_t spill_budget_bytes                       = DEFAULT_SPILL_BUDGET);
+
+    PayloadCache(PayloadCache const&)            = delete;
+    PayloadCache& operator=(PayloadCache const&) = delete;
+
+    [[nodiscard]] CachedPayload find(PayloadKey key);
+    CachedPayload insert(PayloadKey key, std::vector<std::byte> bytes);
+
+    // Whether a payload this big would be kept at all
+    [[nodiscard]] bool fits(std::size_t bytes) const;
+
+    [[nodiscard]] CacheStats stats() const;
+
+private:
+    struct Entry {
+        PayloadKey key;
+        CachedPayload payload;
+    };
+
+    struct SpilledFile {
+        PayloadKey key;
+        std::size_t bytes;
+    };
+
+    std::size_t const _budget;
+    std::optional<std::filesystem::path> const _spill_directory;
+
+    mutable std::mutex _mutex;
+    std::list<Entry> _lru;
+    std::unordered_map<PayloadKey, std::list<Entry>::iterator> _entries;
+    std::size_t _bytes;
+
+    std::atomic<std::uint64_t> _hits;
+    std::atomic<std::uint64_t> _misses;
+    std::atomic<std::uint64_t> _spill_hits;
+    std::atomic<std::uint64_t> _evictions;
+
+    // Files in the spill directory, oldest first, including the ones left
+    // behind by an earlier run
+    std::size_t const _spill_budget;
+    std::mutex _spill_mutex;
+    std::deque<SpilledFile> _spilled;
+    std::unordered_set<PayloadKey> _spilled_keys;
+    std::size_t _spilled_bytes;
+
+    [[nodiscard]] std::filesystem::path spill_path(PayloadKey key) const;
+    [[nodiscard]] CachedPayload load_spilled(PayloadKey key) const;
+    void adopt_spilled();
+    void spill(Entry const& entry);
+
+    // Expects _spill_mutex to be held, returns the files to delete
+    [[nodiscard]] std::vector<PayloadKey> trim_spilled_locked();
+    void remove_spilled(std::vector<PayloadKey> const& keys) const;
+
+    // Expects _mutex to be held
+    void insert_locked(PayloadKey key, CachedPayload payload, std::vector<Entry>& evicted);
+};
+
+
+#endif // PRINTER_PAYLOAD_CACHE_H
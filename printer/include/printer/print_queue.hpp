@@ -0,0 +1,135 @@
+#ifndef PRINTER_PRINT_QUEUE_H
+#define PRINTER_PRINT_QUEUE_H
+
+#include <printer/mpsc_queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class PayloadKind { Text, Pdf, Jpeg, EscPos };
+
+class EscPosDocument;
+
+struct PrintPayload {
+    PayloadKind kind;
+
+    // Raw text or ESC/POS bytes for PayloadKind::Text and PayloadKind::EscPos,
+    // a file path otherwise
+    std::string content;
+
+    [[nodiscard]] static PrintPayload text(std::string text);
+    [[nodiscard]] static PrintPayload pdf(std::string path);
+    [[nodiscard]] static PrintPayload jpeg(std::string path);
+    [[nodiscard]] static PrintPayload escpos(EscPosDocument const& document);
+};
+
+struct JobResult {
+    bool success;
+    std::string printer_name;
+    int job_id;
+    std::string error;
+};
+
+// Nagle-style merging of small raw payloads (text and ESC/POS) queued for
+// the same printer into one job. A batch is sent once no new payload has
+// arrived for window, once it holds max_bytes, or at the latest max_delay
+// after its first payload was taken off the queue.
+struct CoalescingOptions {
+    bool enabled                        = false;
+    std::chrono::milliseconds window    = std::chrono::milliseconds{5};
+    std::chrono::milliseconds max_delay = std::chrono::milliseconds{50};
+    std::size_t max_bytes               = 16 * 1024;
+};
+
+// One worker thread draining a bounded queue of jobs for a single printer.
+// Producers on any thread hand jobs over without locking, and block (or
+// fail, with try_submit) while the queue is full.
+class PrintQueue {
+public:
+    using Handler = std::function<JobResult(std::string const& printer_name, PrintPayload const& payload)>;
+
+    // Runs on the worker once the job is done. The payload is handed back
+    // so it can be moved on, e.g. to another printer after a failure.
+    using Completion = std::function<void(JobResult const& result, PrintPayload& payload)>;
+
+    PrintQueue(std::string printer_name, std::size_t capacity, Handler handler, CoalescingOptions coalescing = {});
+    ~PrintQueue();
+
+    PrintQueue(PrintQueue const&)            = delete;
+    PrintQueue& operator=(PrintQueue const&) = delete;
+
+    [[nodiscard]] std::future<JobResult> submit(PrintPayload payload);
+    [[nodiscard]] std::optional<std::future<JobResult>> try_submit(PrintPayload payload);
+
+    void enqueue(PrintPayload payload, Completion complete);
+
+    // Leaves payload and complete untouched when the queue is full
+    [[nodiscard]] bool try_enqueue(PrintPayload& payload, Completion& complete);
+
+    [[nodiscard]] std::size_t pending() const;
+
+    // Queued jobs plus the one being printed
+    [[nodiscard]] std::size_t outstanding() const;
+
+    // Moving average of how long a job takes, zero until one has finished
+    [[nodiscard]] double seconds_per_job() const;
+
+private:
+    struct QueuedJob {
+        PrintPayload payload;
+        Completion complete;
+    };
+
+    std::string _printer_name;
+    Handler _handler;
+    CoalescingOptions _coalescing;
+    BoundedMpscQueue<QueuedJob> _jobs;
+
+    // Bumped on every push/pop so both sides can sleep with atomic wait
+    std::atomic<std::uint32_t> _pushed;
+    std::atomic<std::uint32_t> _popped;
+
+    // Only used while the worker lingers over a coalescing batch
+    std::mutex _linger_mutex;
+    std::condition_variable _linger_cv;
+    std::atomic<bool> _lingering;
+
+    std::atomic<std::size_t> _outstanding;
+    std::atomic<double> _seconds_per_job;
+
+    std::jthread _worker;
+
+    [[nodiscard]] bool push(QueuedJob& job);
+
+    // Wakes the worker, whether it waits for a job or lingers over a batch
+    void wake();
+    [[nodiscard]] std::optional<QueuedJob> pop();
+    void run(std::stop_token stop);
+
+    [[nodiscard]] bool coalescable(QueuedJob const& job) const;
+
+    // Adds queued payloads to the batch until it is due, returning the job
+    // that ended it early if that one can't join
+    [[nodiscard]] std::optional<QueuedJob> collect(std::vector<QueuedJob>& batch, std::stop_token const& stop);
+
+    // Waits until something was pushed after seen was read, false once
+    // until passed without a push
+    [[nodiscard]] bool linger(std::uint32_t seen, std::chrono::steady_clock::time_point until);
+
+    [[nodiscard]] JobResult handle(PrintPayload const& payload);
+    void complete(QueuedJob& job, JobResult const& result);
+    void run_batch(std::vector<QueuedJob>& batch);
+};
+
+
+#endif // PRINTER_PRINT_QUEUE_H
@@ -0,0 +1,84 @@
+#ifndef PRINTER_BACKEND_H
+#define PRINTER_BACKEND_H
+
+#include <printer/printer_snapshot.hpp>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+// Document formats, the MIME types CUPS expects
+inline constexpr char const* FORMAT_RAW  = "application/vnd.cups-raw";
+inline constexpr char const* FORMAT_PDF  = "application/pdf";
+inline constexpr char const* FORMAT_JPEG = "image/jpeg";
+
+// Final state of a job. Unknown means the monitor stopped, or gave up on
+// the job, before the backend reported it as done.
+enum class JobState { Completed, Aborted, Canceled, Unknown };
+
+struct FinishedJob {
+    int job_id;
+    JobState state;
+
+    // Left at the epoch for stages the job never reached
+    std::chrono::system_clock::time_point created;
+    std::chrono::system_clock::time_point processing;
+    std::chrono::system_clock::time_point completed;
+};
+
+// A job created on one printer. Documents are sent one after the other:
+// start_document, then any number of writes, then finish_document. A last
+// document that wasn't finished is finished (or the job cancelled) when the
+// job goes away, with no way to find out whether the backend accepted it.
+class BackendJob {
+public:
+    virtual ~BackendJob() = default;
+
+    [[nodiscard]] virtual int id() const = 0;
+
+    [[nodiscard]] virtual bool start_document(std::string const& name, std::string const& format, bool last) = 0;
+    [[nodiscard]] virtual bool write(std::span<char const> data) = 0;
+
+    // False when the backend rejected the document. Finishing the last one
+    // closes the job, which is where the backend accepts or rejects it.
+    virtual bool finish_document() = 0;
+
+    // Cancels the job instead of finishing it when it goes away
+    virtual void cancel() = 0;
+};
+
+// Everything PrinterManager needs from the print system. All calls may be
+// made from any thread.
+class PrinterBackend {
+public:
+    virtual ~PrinterBackend() = default;
+
+    // Every printer reachable right now, looking for up to timeout. Printers
+    // listed in known may be handed back as they are. std::nullopt when stop
+    // was requested before discovery finished.
+    [[nodiscard]] virtual std::optional<std::vector<PrinterEntry>> discover(
+        std::chrono::milliseconds timeout, std::stop_token stop, PrinterSnapshot const& known) = 0;
+
+    // nullptr when the job could not be created, see last_error
+    [[nodiscard]] virtual std::unique_ptr<BackendJob> create_job(
+        PrinterEntry const& printer, std::string const& title) = 0;
+
+    // The printer is gone, drops anything kept around for it
+    virtual void forget(std::string const& printer_name) = 0;
+
+    // Jobs of ours the printer is done with, starting at first_job_id so
+    // the reply doesn't grow with the printer's history. std::nullopt when
+    // the printer could not be asked.
+    [[nodiscard]] virtual std::optional<std::vector<FinishedJob>> finished_jobs(
+        std::string const& printer_name, int first_job_id) = 0;
+
+    // Why the last failed call on this thread failed
+    [[nodiscard]] virtual std::string last_error() const = 0;
+};
+
+
+#endif // PRINTER_BACKEND_H
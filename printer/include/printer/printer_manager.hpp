@@ -1,44 +1,60 @@
 #ifndef PRINTER_MANAGER_H
 #define PRINTER_MANAGER_H
 
+#include <printer/escpos.hpp>
+#include <printer/job_monitor.hpp>
+#include <printer/payload_cache.hpp>
+#include <printer/print_queue.hpp>
+#include <printer/printer_backend.hpp>
+#include <printer/printer_pool.hpp>
+#include <printer/printer_snapshot.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-extern "C" {
-typedef struct cups_dest_s cups_dest_t;
-typedef struct cups_option_s cups_option_t;
-typedef struct _cups_dinfo_s cups_dinfo_t;
-}
-
-struct PrinterDetails {
-    std::string name;
-    std::string instance;
-    bool is_default;
-    std::map<std::string, std::string> options;
-};
+struct PrinterManagerConfig {
+    static constexpr std::size_t DEFAULT_QUEUE_CAPACITY = 64;
 
+    // Where jobs are sent, CUPS when unset. Shared so a load test can keep
+    // plugging simulated printers in and out while the manager runs.
+    std::shared_ptr<PrinterBackend> backend = nullptr;
 
-using PrinterOptionBuffer = std::unique_ptr<cups_option_t, std::function<void(cups_option_t*)>>;
-using PrinterOptions      = std::pair<PrinterOptionBuffer, std::shared_ptr<int>>;
+    std::size_t queue_capacity = DEFAULT_QUEUE_CAPACITY;
 
-struct PrinterJob {
-    int job_id;
-    std::string printer_name;
+    // Off by default, merges bursts of small queued text and ESC/POS
+    // payloads into one job per printer
+    CoalescingOptions coalescing = {};
 
-    PrinterJob(std::string const& printer_name, cups_dest_t* dest, cups_dinfo_t* info, std::string const& job_name,
-        PrinterOptions const& options);
-    ~PrinterJob();
+    // Memory budget for rendered payloads, and where evicted payloads are
+    // kept on disk (not at all when unset) within cache_spill_budget
+    std::size_t cache_budget                                   = PayloadCache::DEFAULT_BUDGET;
+    std::optional<std::filesystem::path> cache_spill_directory = std::nullopt;
+    std::size_t cache_spill_budget                             = PayloadCache::DEFAULT_SPILL_BUDGET;
 
-    void cancel();
+    // Discovery runs in the background, enumerating destinations for up to
+    // discovery_timeout and then sleeping for discovery_interval
+    std::chrono::milliseconds discovery_interval = std::chrono::seconds{5};
+    std::chrono::milliseconds discovery_timeout  = std::chrono::milliseconds{1000};
 
-private:
-    bool _cancelled;
-    cups_dest_t* _cups_dest;
-    cups_dinfo_t* _cups_info;
+    // How often in-flight jobs are checked on, and how long until one the
+    // backend never reports is given up on, see JobMonitor
+    std::chrono::milliseconds job_poll_interval = JobMonitor::DEFAULT_POLL_INTERVAL;
+    std::chrono::milliseconds job_max_age       = JobMonitor::DEFAULT_MAX_AGE;
 };
 
 
@@ -46,35 +62,122 @@ private:
 // TODO : do we want to rename it?
 class PrinterManager {
 public:
-    PrinterManager();
+    // Returns straight away, printers show up as discovery finds them
+    explicit PrinterManager(PrinterManagerConfig config = {});
     ~PrinterManager();
 
-    void add_printer(std::string const& name, cups_dest_s* instance);
-    void remove_printer(std::string const& name, cups_dest_s* instance);
+    // Entries come from the backend, see CupsBackend::make_entry. Discovery
+    // replaces them on its next pass.
+    void add_printer(PrinterEntry entry);
+    void remove_printer(std::string const& name);
+
+    // Waits until the first discovery pass is done, false on timeout
+    [[nodiscard]] bool wait_for_printers(std::chrono::milliseconds timeout) const;
 
     [[nodiscard]] std::vector<std::string> printers() const;
 
-    [[nodiscard]] bool print_text(std::string const& printer_name, std::string const& text);
+    // Text and raw bytes go straight from memory to the printer, as FORMAT_RAW
+    [[nodiscard]] bool print_text(std::string const& printer_name, std::string_view text);
+    [[nodiscard]] bool print_bytes(std::string const& printer_name, std::span<std::byte const> bytes);
+
+    // Sends the document as a single raw document, the reset it starts with
+    // replaces the separate reset document other prints get
+    [[nodiscard]] bool print_escpos(std::string const& printer_name, EscPosDocument const& document);
+
+    // Files and rendered images are cached, so reprinting the same unchanged
+    // file skips reading and rendering it
     [[nodiscard]] bool print_pdf(std::string const& printer_name, std::string const& pdf_path);
+
+    // Rasterized in process for the thermal head and sent as ESC/POS, CUPS
+    // only rasterizes the JPEG itself when that fails
     [[nodiscard]] bool print_jpeg(std::string const& printer_name, std::string const& image_path);
 
-    // bool printer_info(std::string const& name) const;
+    // Queues the payload on the printer's own worker. Blocks while that
+    // printer's queue is full, try_submit returns std::nullopt instead.
+    // A printer that isn't registered fails the job straight away.
+    [[nodiscard]] std::future<JobResult> submit(std::string const& printer_name, PrintPayload payload);
+    [[nodiscard]] std::optional<std::future<JobResult>> try_submit(
+        std::string const& printer_name, PrintPayload payload);
 
-private:
-    std::map<std::string, PrinterDetails> _printer_details;
-    std::map<std::string, cups_dinfo_t*> _infos;
+    // Groups interchangeable printers under one name, false if the name is
+    // taken or no printers are given. Members don't have to be discovered yet.
+    bool create_pool(std::string const& pool_name, std::vector<std::string> printers, PoolPolicy policy);
+    bool remove_pool(std::string const& pool_name);
+
+    // Queues the payload on the member the pool's policy picks. Members that
+    // dropped out of discovery are skipped, and a failed job is moved on to
+    // the next member until one succeeds or all of them have been tried.
+    [[nodiscard]] std::future<JobResult> submit_to_pool(std::string const& pool_name, PrintPayload payload);
+
+    // Resolves once the backend reports the printed job as completed, aborted or
+    // canceled. A result that never became a job resolves straight away.
+    [[nodiscard]] std::future<JobCompletion> track_job(JobResult const& result);
+    void track_job(JobResult const& result, JobMonitor::Callback callback);
 
-    std::map<std::string, int> _cups_dests_indices;
-    cups_dest_t* _cups_dests_array;
-    int _cups_num_dests;
+    [[nodiscard]] CacheStats cache_stats() const;
 
-    void poll_destinations();
-    [[nodiscard]] std::optional<std::pair<cups_dest_t*, cups_dinfo_t*>> query_printer(std::string const& printer_name);
-    [[nodiscard]] std::optional<PrinterJob> create_printer_job(
-        std::string const& printer_name, std::string const& job_name, PrinterOptions const& options);
+    // Jobs created so far, coalesced payloads share one
+    [[nodiscard]] std::uint64_t jobs_created() const;
 
-    [[nodiscard]] bool print_file(
+    // bool printer_info(std::string const& name) const;
+
+private:
+    // Readers only ever load the current snapshot, writers build a new one
+    // and swap it in under _snapshot_write_mutex
+    std::atomic<std::shared_ptr<PrinterSnapshot const>> _snapshot;
+    std::mutex _snapshot_write_mutex;
+
+    std::chrono::milliseconds _discovery_interval;
+    std::chrono::milliseconds _discovery_timeout;
+    mutable std::mutex _discovery_mutex;
+    mutable std::condition_variable_any _discovery_cv;
+    bool _discovered;
+
+    std::shared_ptr<PrinterBackend> _backend;
+    PayloadCache _cache;
+    JobMonitor _monitor;
+
+    // Queues are shared so a worker failing a pool job over to another
+    // printer keeps that printer's queue alive while handing the job over
+    std::size_t _queue_capacity;
+    CoalescingOptions _coalescing;
+    std::mutex _queues_mutex;
+    std::map<std::string, std::shared_ptr<PrintQueue>> _queues;
+    bool _shutting_down;
+
+    std::mutex _pools_mutex;
+    std::map<std::string, std::shared_ptr<PrinterPool>> _pools;
+
+    std::atomic<std::uint64_t> _jobs_created;
+
+    std::jthread _discovery;
+
+    void discover(std::stop_token stop);
+    void poll_destinations(std::stop_token const& stop);
+    void publish(std::vector<PrinterEntry> printers);
+    struct PoolDispatch;
+
+    // nullptr once the manager is shutting down or for a printer that isn't
+    // in the current snapshot, queue_error says which
+    [[nodiscard]] std::shared_ptr<PrintQueue> queue_for(std::string const& printer_name);
+    [[nodiscard]] bool shutting_down();
+    [[nodiscard]] std::string queue_error(std::string const& printer_name);
+    [[nodiscard]] std::shared_ptr<PrintQueue> find_queue(std::string const& printer_name);
+    void dispatch_pool_job(std::shared_ptr<PoolDispatch> const& dispatch, PrintPayload payload, bool may_block);
+    [[nodiscard]] JobResult run_job(std::string const& printer_name, PrintPayload const& payload);
+    [[nodiscard]] std::shared_ptr<PrinterEntry const> query_printer(std::string const& printer_name) const;
+    [[nodiscard]] std::unique_ptr<BackendJob> create_printer_job(
+        PrinterEntry const& printer, std::string const& job_name);
+
+    using DocumentWriter = std::function<bool(BackendJob&)>;
+
+    [[nodiscard]] JobResult print_document(std::string const& printer_name, std::string const& document_name,
+        std::string const& format, DocumentWriter const& write_document, bool reset_first = true);
+    [[nodiscard]] JobResult print_file(
         std::string const& printer_name, std::string const& file_path, std::string const& format);
+    [[nodiscard]] JobResult print_buffer(std::string const& printer_name, std::span<std::byte const> bytes,
+        std::string const& format, bool reset_first = true);
+    [[nodiscard]] JobResult print_image(std::string const& printer_name, std::string const& image_path);
 };
 
 
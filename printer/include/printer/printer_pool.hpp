@@ -0,0 +1,47 @@
+#ifndef PRINTER_PRINTER_POOL_H
+#define PRINTER_PRINTER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class PoolPolicy { LeastOutstanding, RoundRobin, WeightedThroughput };
+
+// What the pool knows about one member when picking where a job goes
+struct MemberLoad {
+    std::string_view name;
+    bool available;
+    std::size_t outstanding;
+    double seconds_per_job;
+};
+
+// A named set of interchangeable printers. The pool only decides the order
+// in which members are tried; PrinterManager does the dispatching and moves
+// on to the next member when one fails.
+class PrinterPool {
+public:
+    PrinterPool(std::string name, std::vector<std::string> members, PoolPolicy policy);
+
+    PrinterPool(PrinterPool const&)            = delete;
+    PrinterPool& operator=(PrinterPool const&) = delete;
+
+    [[nodiscard]] std::string const& name() const;
+    [[nodiscard]] std::vector<std::string> const& members() const;
+    [[nodiscard]] PoolPolicy policy() const;
+
+    // Available members, best candidate first. loads is indexed like members().
+    [[nodiscard]] std::vector<std::string> rank(std::span<MemberLoad const> loads);
+
+private:
+    std::string const _name;
+    std::vector<std::string> const _members;
+    PoolPolicy const _policy;
+
+    std::atomic<std::size_t> _cursor;
+};
+
+
+#endif // PRINTER_PRINTER_POOL_H
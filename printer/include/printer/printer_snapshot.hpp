@@ -0,0 +1,50 @@
+#ifndef PRINTER_SNAPSHOT_H
+#define PRINTER_SNAPSHOT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PrinterDetails {
+    std::string name;
+    std::string instance;
+    bool is_default;
+    std::map<std::string, std::string> options;
+};
+
+// Whatever a PrinterBackend needs to reach one printer. Only the backend
+// that discovered the printer knows what is behind it.
+class PrinterHandle {
+public:
+    virtual ~PrinterHandle() = default;
+};
+
+// A printer and its handle, owned by the entry (and shared with any newer
+// snapshot that still lists the printer)
+struct PrinterEntry {
+    PrinterDetails details;
+    std::shared_ptr<PrinterHandle const> handle;
+};
+
+// Immutable set of printers, published as a whole whenever discovery sees
+// a change. Entries are kept sorted by name in one flat vector.
+class PrinterSnapshot {
+public:
+    PrinterSnapshot(std::vector<PrinterEntry> printers, std::uint64_t generation);
+
+    [[nodiscard]] PrinterEntry const* find(std::string_view name) const;
+    [[nodiscard]] std::vector<PrinterEntry> const& printers() const;
+    [[nodiscard]] std::uint64_t generation() const;
+
+    [[nodiscard]] bool same_printers(std::vector<std::string> const& sorted_names) const;
+
+private:
+    std::vector<PrinterEntry> _printers;
+    std::uint64_t _generation;
+};
+
+
+#endif // PRINTER_SNAPSHOT_H
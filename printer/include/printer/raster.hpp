@@ -0,0 +1,58 @@
+#ifndef PRINTER_RASTER_H
+#define PRINTER_RASTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// 80mm rolls at 203dpi
+inline constexpr std::size_t THERMAL_HEAD_WIDTH = 576;
+
+struct GrayImage {
+    std::size_t width;
+    std::size_t height;
+
+    // Row-major, one byte per pixel, 0 is black
+    std::vector<std::uint8_t> pixels;
+};
+
+// 1bpp image in the ESC/POS "GS v 0" layout: rows of bytes_per_row() bytes,
+// most significant bit is the leftmost dot, a set bit is a black dot.
+struct RasterImage {
+    std::size_t width;
+    std::size_t height;
+    std::vector<std::uint8_t> bits;
+
+    [[nodiscard]] std::size_t bytes_per_row() const;
+};
+
+enum class DitherMode { FloydSteinberg, Ordered };
+
+// Kernels used by the ordered dither, all of them produce the same bits
+enum class SimdLevel { Scalar, Sse, Avx2 };
+
+struct RasterOptions {
+    std::size_t width = THERMAL_HEAD_WIDTH;
+    DitherMode dither = DitherMode::FloydSteinberg;
+};
+
+[[nodiscard]] SimdLevel best_simd_level();
+
+// Decodes straight to grayscale, letting libjpeg downscale in the DCT
+// domain as long as the result stays at least min_width wide.
+[[nodiscard]] std::optional<GrayImage> decode_jpeg(std::span<std::byte const> jpeg, std::size_t min_width);
+[[nodiscard]] std::optional<GrayImage> decode_jpeg_file(std::string const& path, std::size_t min_width);
+
+// Bilinear resize keeping the aspect ratio
+[[nodiscard]] GrayImage scale_to_width(GrayImage const& image, std::size_t width);
+
+[[nodiscard]] RasterImage dither_floyd_steinberg(GrayImage const& image);
+[[nodiscard]] RasterImage dither_ordered(GrayImage const& image, SimdLevel level = best_simd_level());
+
+[[nodiscard]] std::optional<RasterImage> rasterize_jpeg(std::string const& path, RasterOptions const& options = {});
+
+
+#endif // PRINTER_RASTER_H
@@ -0,0 +1,79 @@
+#ifndef PRINTER_SIMULATED_BACKEND_H
+#define PRINTER_SIMULATED_BACKEND_H
+
+#include <printer/printer_backend.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+struct SimulatedPrinterOptions {
+    // Bytes per second a job is written at, unlimited when 0
+    std::size_t bandwidth = 0;
+
+    // Time taken to create a job, and again to finish it
+    std::chrono::microseconds job_latency{0};
+
+    // Chance of any one job failing, from 0 to 1
+    double failure_rate = 0.0;
+};
+
+struct SimulatedPrinterStats {
+    std::uint64_t jobs_created;
+    std::uint64_t jobs_completed;
+    std::uint64_t jobs_failed;
+    std::uint64_t bytes_received;
+};
+
+// In-process printers for load tests, nothing is sent anywhere. Printers
+// can be plugged in and out at any time: discovery sees the change on its
+// next pass, and jobs still running on an unplugged printer fail.
+class SimulatedBackend final : public PrinterBackend {
+public:
+    // Finished jobs kept per printer for finished_jobs, oldest dropped first
+    static constexpr std::size_t FINISHED_JOB_HISTORY = 1000;
+
+    // The same seed fails the same jobs
+    explicit SimulatedBackend(std::uint64_t seed = 0);
+    ~SimulatedBackend() override;
+
+    SimulatedBackend(SimulatedBackend const&)            = delete;
+    SimulatedBackend& operator=(SimulatedBackend const&) = delete;
+
+    // Replaces a printer of the same name, starting it over
+    void plug_in(std::string const& name, SimulatedPrinterOptions options = {});
+    void unplug(std::string const& name);
+
+    [[nodiscard]] std::optional<SimulatedPrinterStats> stats(std::string const& name) const;
+
+    [[nodiscard]] std::optional<std::vector<PrinterEntry>> discover(
+        std::chrono::milliseconds timeout, std::stop_token stop, PrinterSnapshot const& known) override;
+    [[nodiscard]] std::unique_ptr<BackendJob> create_job(
+        PrinterEntry const& printer, std::string const& title) override;
+    void forget(std::string const& printer_name) override;
+    [[nodiscard]] std::optional<std::vector<FinishedJob>> finished_jobs(
+        std::string const& printer_name, int first_job_id) override;
+    [[nodiscard]] std::string last_error() const override;
+
+private:
+    struct Printer;
+    class Job;
+
+    mutable std::mutex _mutex;
+    std::map<std::string, std::shared_ptr<Printer>> _printers;
+    std::mt19937_64 _random;
+    int _next_job_id;
+
+    [[nodiscard]] std::shared_ptr<Printer> find(std::string const& name) const;
+};
+
+
+#endif // PRINTER_SIMULATED_BACKEND_H
@@ -0,0 +1,167 @@
+#include <printer/job_monitor.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+    void resolve(JobMonitor::Callback const& callback, JobCompletion const& completion) {
+        try {
+            callback(completion);
+        } catch (...) {
+            spdlog::error("completion callback for job {} on printer {} threw", completion.job_id,
+                completion.printer_name);
+        }
+    }
+
+} // namespace
+
+JobMonitor::JobMonitor(
+    PrinterBackend& backend, std::chrono::milliseconds poll_interval, std::chrono::milliseconds max_age)
+    : _backend{backend}, _poll_interval{poll_interval}, _max_age{max_age}, _watched{},
+      _poller{[this](std::stop_token stop) { run(std::move(stop)); }} {}
+
+JobMonitor::~JobMonitor() {
+    _poller.request_stop();
+    if (_poller.joinable()) {
+        _poller.join();
+    }
+
+    for (auto const& [printer_name, watches] : _watched) {
+        for (auto const& watch : watches) {
+            resolve(watch.callback, JobCompletion{.printer_name = printer_name,
+                                     .job_id                     = watch.job_id,
+                                     .state                      = JobState::Unknown,
+                                     .created                    = {},
+                                     .processing                 = {},
+                                     .completed                  = {}});
+        }
+    }
+}
+
+void JobMonitor::watch(std::string const& printer_name, int job_id, Callback callback) {
+    {
+        std::scoped_lock lock{_mutex};
+        _watched[printer_name].push_back(
+            Watch{.job_id = job_id, .since = std::chrono::steady_clock::now(), .callback = std::move(callback)});
+    }
+    _wake.notify_one();
+}
+
+std::future<JobCompletion> JobMonitor::watch(std::string const& printer_name, int job_id) {
+    auto promise = std::make_shared<std::promise<JobCompletion>>();
+    auto future  = promise->get_future();
+
+    watch(printer_name, job_id, [promise](JobCompletion const& completion) { promise->set_value(completion); });
+    return future;
+}
+
+std::size_t JobMonitor::in_flight() const {
+    std::scoped_lock lock{_mutex};
+
+    std::size_t count = 0;
+    for (auto const& [printer_name, watches] : _watched) {
+        count += watches.size();
+    }
+
+    return count;
+}
+
+void JobMonitor::run(std::stop_token stop) {
+    while (!stop.stop_requested()) {
+        {
+            // Nothing to ask the backend about until a job is watched
+            std::unique_lock lock{_mutex};
+            if (!_wake.wait(lock, stop, [this] { return !_watched.empty(); })) {
+                return;
+            }
+        }
+
+        poll();
+
+        std::unique_lock lock{_mutex};
+        _wake.wait_for(lock, stop, _poll_interval, [] { return false; });
+    }
+}
+
+void JobMonitor::poll() {
+    // Each printer with the oldest job watched on it
+    std::vector<std::pair<std::string, int>> printers;
+    {
+        std::scoped_lock lock{_mutex};
+        printers.reserve(_watched.size());
+        for (auto const& [printer_name, watches] : _watched) {
+            auto const oldest = std::ranges::min(watches, {}, &Watch::job_id).job_id;
+            printers.emplace_back(printer_name, oldest);
+        }
+    }
+
+    for (auto const& [printer_name, first_job_id] : printers) {
+        // Jobs that are too old still expire while the backend can't be asked
+        auto const jobs = _backend.finished_jobs(printer_name, first_job_id);
+        if (!jobs) {
+            spdlog::warn("could not get jobs for printer {}: {}", printer_name, _backend.last_error());
+        }
+
+        std::unordered_map<int, FinishedJob const*> finished;
+        if (jobs) {
+            finished.reserve(jobs->size());
+            for (auto const& job : *jobs) {
+                finished.emplace(job.job_id, &job);
+            }
+        }
+
+        auto const expired_before = std::chrono::steady_clock::now() - _max_age;
+
+        // Callbacks run after the lock is released, they may watch more jobs
+        std::vector<std::pair<Callback, JobCompletion>> resolved;
+        {
+            std::scoped_lock lock{_mutex};
+            auto const found = _watched.find(printer_name);
+            if (found == end(_watched)) {
+                continue;
+            }
+
+            std::erase_if(found->second, [&](Watch& watch) {
+                auto const job = finished.find(watch.job_id);
+                if (job == end(finished)) {
+                    if (watch.since >= expired_before) {
+                        return false;
+                    }
+
+                    spdlog::warn("gave up on job {} on printer {}, it was never reported done", watch.job_id,
+                        printer_name);
+                    resolved.emplace_back(std::move(watch.callback),
+                        JobCompletion{.printer_name = printer_name,
+                         .job_id                    = watch.job_id,
+                         .state                     = JobState::Unknown,
+                         .created                   = {},
+                         .processing                = {},
+                         .completed                 = {}});
+                    return true;
+                }
+
+                resolved.emplace_back(std::move(watch.callback),
+                    JobCompletion{.printer_name = printer_name,
+                     .job_id                    = watch.job_id,
+                     .state                     = job->second->state,
+                     .created                   = job->second->created,
+                     .processing                = job->second->processing,
+                     .completed                 = job->second->completed});
+                return true;
+            });
+
+            if (found->second.empty()) {
+                _watched.erase(found);
+            }
+        }
+
+        for (auto const& [callback, completion] : resolved) {
+            resolve(callback, completion);
+        }
+    }
+}
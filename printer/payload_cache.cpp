@@ -0,0 +1,308 @@
+#include <printer/payload_cache.hpp>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace {
+
+    constexpr std::uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+} // namespace
+
+PayloadHasher& PayloadHasher::add(std::span<std::byte const> bytes) {
+    for (auto const byte : bytes) {
+        _state = (_state ^ static_cast<std::uint64_t>(byte)) * FNV_PRIME;
+    }
+
+    return *this;
+}
+
+PayloadHasher& PayloadHasher::add(std::string_view text) {
+    // Length first, so ("ab", "c") and ("a", "bc") hash differently
+    add(static_cast<std::uint64_t>(text.size()));
+    return add(std::as_bytes(std::span{text}));
+}
+
+PayloadHasher& PayloadHasher::add(std::uint64_t value) {
+    for (int shift = 0; shift < 64; shift += 8) {
+        _state = (_state ^ ((value >> shift) & 0xFF)) * FNV_PRIME;
+    }
+
+    return *this;
+}
+
+PayloadKey PayloadHasher::key() const {
+    return _state;
+}
+
+PayloadCache::PayloadCache(
+    std::size_t budget_bytes, std::optional<std::filesystem::path> spill_directory, std::size_t spill_budget_bytes)
+    : _budget{budget_bytes}, _spill_directory{std::move(spill_directory)}, _lru{}, _entries{}, _bytes{0}, _hits{0},
+      _misses{0}, _spill_hits{0}, _evictions{0}, _spill_budget{spill_budget_bytes}, _spilled{}, _spilled_keys{},
+      _spilled_bytes{0} {
+
+    if (_spill_directory) {
+        std::error_code error;
+        std::filesystem::create_directories(*_spill_directory, error);
+        if (error) {
+            spdlog::error("could not create cache spill directory {}: {}", _spill_directory->string(), error.message());
+            return;
+        }
+
+        adopt_spilled();
+    }
+}
+
+CachedPayload PayloadCache::find(PayloadKey key) {
+    {
+        std::scoped_lock lock{_mutex};
+        auto const found = _entries.find(key);
+        if (found != end(_entries)) {
+            _lru.splice(begin(_lru), _lru, found->second);
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return found->second->payload;
+        }
+    }
+
+    if (auto spilled = load_spilled(key)) {
+        std::vector<Entry> evicted;
+        {
+            std::scoped_lock lock{_mutex};
+            insert_locked(key, spilled, evicted);
+        }
+
+        for (auto const& entry : evicted) {
+            spill(entry);
+        }
+
+        _hits.fetch_add(1, std::memory_order_relaxed);
+        _spill_hits.fetch_add(1, std::memory_order_relaxed);
+        return spilled;
+    }
+
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+CachedPayload PayloadCache::insert(PayloadKey key, std::vector<std::byte> bytes) {
+    auto payload = std::make_shared<std::vector<std::byte> const>(std::move(bytes));
+    if (!fits(payload->size())) {
+        return payload;
+    }
+
+    std::vector<Entry> evicted;
+    {
+        std::scoped_lock lock{_mutex};
+        insert_locked(key, payload, evicted);
+    }
+
+    // Disk writes happen outside the lock
+    for (auto const& entry : evicted) {
+        spill(entry);
+    }
+
+    return payload;
+}
+
+bool PayloadCache::fits(std::size_t bytes) const {
+    // A single payload may take at most a quarter of the budget
+    return bytes <= _budget / 4;
+}
+
+CacheStats PayloadCache::stats() const {
+    std::scoped_lock lock{_mutex};
+    return CacheStats{.hits = _hits.load(std::memory_order_relaxed),
+     .misses                = _misses.load(std::memory_order_relaxed),
+     .spill_hits            = _spill_hits.load(std::memory_order_relaxed),
+     .evictions             = _evictions.load(std::memory_order_relaxed),
+     .entries               = _entries.size(),
+     .bytes                 = _bytes};
+}
+
+void PayloadCache::insert_locked(PayloadKey key, CachedPayload payload, std::vector<Entry>& evicted) {
+    auto const found = _entries.find(key);
+    if (found != end(_entries)) {
+        _bytes -= found->second->payload->size();
+        _lru.erase(found->second);
+        _entries.erase(found);
+    }
+
+    _bytes += payload->size();
+    _lru.push_front(Entry{.key = key, .payload = std::move(payload)});
+    _entries[key] = begin(_lru);
+
+    while (_bytes > _budget && !_lru.empty()) {
+        auto& oldest = _lru.back();
+        _bytes -= oldest.payload->size();
+        _entries.erase(oldest.key);
+        evicted.push_back(std::move(oldest));
+        _lru.pop_back();
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::filesystem::path PayloadCache::spill_path(PayloadKey key) const {
+    return *_spill_directory / fmt::format("{:016x}.bin", key);
+}
+
+void PayloadCache::adopt_spilled() {
+    struct Found {
+        std::filesystem::file_time_type written;
+        SpilledFile file;
+    };
+
+    std::vector<Found> found;
+    std::error_code list_error;
+    for (std::filesystem::directory_iterator item{*_spill_directory, list_error}, last; !list_error && item != last;
+         item.increment(list_error)) {
+        auto const& path = item->path();
+        std::error_code error;
+
+        // Left behind by a run that stopped halfway through a write
+        if (path.extension() == ".tmp") {
+            std::filesystem::remove(path, error);
+            continue;
+        }
+
+        auto const stem          = path.stem().string();
+        PayloadKey key           = 0;
+        auto const [end, parsed] = std::from_chars(stem.data(), stem.data() + stem.size(), key, 16);
+        if (path.extension() != ".bin" || parsed != std::errc{} || end != stem.data() + stem.size()) {
+            continue;
+        }
+
+        auto const size    = item->file_size(error);
+        auto const written = item->last_write_time(error);
+        if (!error) {
+            found.push_back(Found{.written = written, .file = SpilledFile{.key = key, .bytes = size}});
+        }
+    }
+
+    if (list_error) {
+        spdlog::warn("could not list cache spill directory {}: {}", _spill_directory->string(), list_error.message());
+    }
+
+    std::ranges::sort(found, {}, &Found::written);
+
+    std::vector<PayloadKey> removed;
+    {
+        std::scoped_lock lock{_spill_mutex};
+        for (auto const& [_, file] : found) {
+            _spilled.push_back(file);
+            _spilled_keys.insert(file.key);
+            _spilled_bytes += file.bytes;
+        }
+
+        removed = trim_spilled_locked();
+    }
+
+    remove_spilled(removed);
+}
+
+std::vector<PayloadKey> PayloadCache::trim_spilled_locked() {
+    std::vector<PayloadKey> removed;
+    while (_spilled_bytes > _spill_budget && !_spilled.empty()) {
+        auto const oldest = _spilled.front();
+        _spilled.pop_front();
+        _spilled_keys.erase(oldest.key);
+        _spilled_bytes -= oldest.bytes;
+        removed.push_back(oldest.key);
+    }
+
+    return removed;
+}
+
+void PayloadCache::remove_spilled(std::vector<PayloadKey> const& keys) const {
+    for (auto const key : keys) {
+        std::error_code error;
+        std::filesystem::remove(spill_path(key), error);
+        if (error) {
+            spdlog::warn("could not remove spilled payload {}: {}", spill_path(key).string(), error.message());
+        }
+    }
+}
+
+CachedPayload PayloadCache::load_spilled(PayloadKey key) const {
+    if (!_spill_directory) {
+        return nullptr;
+    }
+
+    auto const path = spill_path(key);
+
+    std::error_code error;
+    auto const size = std::filesystem::file_size(path, error);
+    if (error) {
+        return nullptr;
+    }
+
+    std::vector<std::byte> bytes(size);
+    std::ifstream file{path, std::ios::binary};
+    if (!file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size))) {
+        spdlog::warn("could not read spilled payload {}", path.string());
+        return nullptr;
+    }
+
+    return std::make_shared<std::vector<std::byte> const>(std::move(bytes));
+}
+
+void PayloadCache::spill(Entry const& entry) {
+    if (!_spill_directory || entry.payload->size() > _spill_budget) {
+        return;
+    }
+
+    // Claimed before writing, so two threads evicting the same payload
+    // don't both count it
+    {
+        std::scoped_lock lock{_spill_mutex};
+        if (!_spilled_keys.insert(entry.key).second) {
+            return;
+        }
+    }
+
+    auto const path = spill_path(entry.key);
+
+    // Written next to the final name and renamed, so readers never see a
+    // partially written payload
+    auto temp_path = path;
+    temp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    bool written = false;
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<char const*>(entry.payload->data()),
+            static_cast<std::streamsize>(entry.payload->size()));
+        written = static_cast<bool>(file);
+    }
+
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(temp_path, path, error);
+    }
+
+    if (!written || error) {
+        spdlog::warn("could not spill payload to {}", path.string());
+        std::filesystem::remove(temp_path, error);
+
+        std::scoped_lock lock{_spill_mutex};
+        _spilled_keys.erase(entry.key);
+        return;
+    }
+
+    std::vector<PayloadKey> removed;
+    {
+        std::scoped_lock lock{_spill_mutex};
+        _spilled.push_back(SpilledFile{.key = entry.key, .bytes = entry.payload->size()});
+        _spilled_bytes += entry.payload->size();
+        removed = trim_spilled_locked();
+    }
+
+    remove_spilled(removed);
+}
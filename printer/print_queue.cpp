@@ -0,0 +1,279 @@
+#include <printer/print_queue.hpp>
+
+#include <printer/escpos.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+PrintPayload PrintPayload::text(std::string text) {
+    return PrintPayload{.kind = PayloadKind::Text, .content = std::move(text)};
+}
+
+PrintPayload PrintPayload::pdf(std::string path) {
+    return PrintPayload{.kind = PayloadKind::Pdf, .content = std::move(path)};
+}
+
+PrintPayload PrintPayload::jpeg(std::string path) {
+    return PrintPayload{.kind = PayloadKind::Jpeg, .content = std::move(path)};
+}
+
+PrintPayload PrintPayload::escpos(EscPosDocument const& document) {
+    auto const bytes = document.bytes();
+    return PrintPayload{.kind = PayloadKind::EscPos,
+     .content                 = std::string{reinterpret_cast<char const*>(bytes.data()), bytes.size()}};
+}
+
+PrintQueue::PrintQueue(std::string printer_name, std::size_t capacity, Handler handler, CoalescingOptions coalescing)
+    : _printer_name{std::move(printer_name)}, _handler{std::move(handler)}, _coalescing{coalescing}, _jobs{capacity},
+      _pushed{0}, _popped{0}, _lingering{false}, _outstanding{0}, _seconds_per_job{0.0},
+      _worker{[this](std::stop_token stop) { run(std::move(stop)); }} {}
+
+PrintQueue::~PrintQueue() {
+    // The worker drains whatever is still queued before it exits
+    _worker.request_stop();
+    wake();
+}
+
+std::future<JobResult> PrintQueue::submit(PrintPayload payload) {
+    auto promise = std::make_shared<std::promise<JobResult>>();
+    auto future  = promise->get_future();
+
+    enqueue(std::move(payload), [promise](JobResult const& result, PrintPayload&) { promise->set_value(result); });
+    return future;
+}
+
+std::optional<std::future<JobResult>> PrintQueue::try_submit(PrintPayload payload) {
+    auto promise = std::make_shared<std::promise<JobResult>>();
+    auto future  = promise->get_future();
+
+    Completion complete = [promise](JobResult const& result, PrintPayload&) { promise->set_value(result); };
+    if (!try_enqueue(payload, complete)) {
+        spdlog::warn("print queue for printer {} is full", _printer_name);
+        return std::nullopt;
+    }
+
+    return std::make_optional(std::move(future));
+}
+
+void PrintQueue::enqueue(PrintPayload payload, Completion complete) {
+    QueuedJob job{.payload = std::move(payload), .complete = std::move(complete)};
+
+    for (;;) {
+        auto const seen = _popped.load(std::memory_order_acquire);
+        if (push(job)) {
+            return;
+        }
+
+        // Backpressure: wait for the worker to free a slot
+        _popped.wait(seen, std::memory_order_acquire);
+    }
+}
+
+bool PrintQueue::try_enqueue(PrintPayload& payload, Completion& complete) {
+    QueuedJob job{.payload = std::move(payload), .complete = std::move(complete)};
+    if (push(job)) {
+        return true;
+    }
+
+    // Hand both back untouched, the caller may try another queue
+    payload  = std::move(job.payload);
+    complete = std::move(job.complete);
+    return false;
+}
+
+std::size_t PrintQueue::pending() const {
+    return _jobs.size_approx();
+}
+
+std::size_t PrintQueue::outstanding() const {
+    return _outstanding.load(std::memory_order_relaxed);
+}
+
+double PrintQueue::seconds_per_job() const {
+    return _seconds_per_job.load(std::memory_order_relaxed);
+}
+
+bool PrintQueue::push(QueuedJob& job) {
+    // Counted before the push so the worker can never decrement first
+    _outstanding.fetch_add(1, std::memory_order_relaxed);
+    if (!_jobs.try_push(job)) {
+        _outstanding.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    wake();
+    return true;
+}
+
+void PrintQueue::wake() {
+    // Sequentially consistent with the worker setting _lingering before it
+    // checks _pushed, so one of the two always sees the other
+    _pushed.fetch_add(1);
+    _pushed.notify_one();
+
+    if (_lingering.load()) {
+        std::scoped_lock lock{_linger_mutex};
+        _linger_cv.notify_one();
+    }
+}
+
+std::optional<PrintQueue::QueuedJob> PrintQueue::pop() {
+    auto job = _jobs.try_pop();
+    if (job) {
+        _popped.fetch_add(1, std::memory_order_release);
+        _popped.notify_all();
+    }
+
+    return job;
+}
+
+void PrintQueue::run(std::stop_token stop) {
+    // Ended the previous batch without joining it
+    std::optional<QueuedJob> carried;
+
+    for (;;) {
+        auto const seen = _pushed.load(std::memory_order_acquire);
+        auto job        = carried ? std::exchange(carried, std::nullopt) : pop();
+
+        if (!job) {
+            if (stop.stop_requested()) {
+                return;
+            }
+
+            _pushed.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        if (!coalescable(*job)) {
+            complete(*job, handle(job->payload));
+            continue;
+        }
+
+        std::vector<QueuedJob> batch;
+        batch.push_back(std::move(*job));
+        carried = collect(batch, stop);
+        run_batch(batch);
+    }
+}
+
+bool PrintQueue::coalescable(QueuedJob const& job) const {
+    auto const raw = job.payload.kind == PayloadKind::Text || job.payload.kind == PayloadKind::EscPos;
+    return _coalescing.enabled && raw && job.payload.content.size() < _coalescing.max_bytes;
+}
+
+std::optional<PrintQueue::QueuedJob> PrintQueue::collect(std::vector<QueuedJob>& batch, std::stop_token const& stop) {
+    auto const deadline = std::chrono::steady_clock::now() + _coalescing.max_delay;
+    auto idle_until     = std::chrono::steady_clock::now() + _coalescing.window;
+    auto bytes          = batch.front().payload.content.size();
+
+    while (bytes < _coalescing.max_bytes && !stop.stop_requested()) {
+        auto const seen = _pushed.load(std::memory_order_acquire);
+        auto job        = pop();
+        if (!job) {
+            if (!linger(seen, std::min(idle_until, deadline))) {
+                break;
+            }
+            continue;
+        }
+
+        auto const size = job->payload.content.size();
+        if (!coalescable(*job) || bytes + size > _coalescing.max_bytes) {
+            return job;
+        }
+
+        bytes += size;
+        batch.push_back(std::move(*job));
+        idle_until = std::chrono::steady_clock::now() + _coalescing.window;
+    }
+
+    return std::nullopt;
+}
+
+bool PrintQueue::linger(std::uint32_t seen, std::chrono::steady_clock::time_point until) {
+    // atomic wait can't time out, so a lingering worker sleeps on the
+    // condition variable and producers only lock to wake it
+    std::unique_lock lock{_linger_mutex};
+    _lingering.store(true);
+    auto const pushed = _linger_cv.wait_until(lock, until, [this, seen] { return _pushed.load() != seen; });
+    _lingering.store(false);
+
+    return pushed;
+}
+
+JobResult PrintQueue::handle(PrintPayload const& payload) {
+    // Weight of the latest job in the moving average
+    constexpr double SMOOTHING = 0.2;
+
+    auto const start = std::chrono::steady_clock::now();
+
+    JobResult result;
+    try {
+        result = _handler(_printer_name, payload);
+    } catch (std::exception const& e) {
+        spdlog::error("print job for printer {} threw: {}", _printer_name, e.what());
+        result = JobResult{.success = false, .printer_name = _printer_name, .job_id = 0, .error = e.what()};
+    } catch (...) {
+        spdlog::error("print job for printer {} threw", _printer_name);
+        result = JobResult{
+         .success = false, .printer_name = _printer_name, .job_id = 0, .error = "print handler threw"};
+    }
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto const average = _seconds_per_job.load(std::memory_order_relaxed);
+    _seconds_per_job.store(
+        average == 0.0 ? elapsed : average + SMOOTHING * (elapsed - average), std::memory_order_relaxed);
+
+    return result;
+}
+
+void PrintQueue::complete(QueuedJob& job, JobResult const& result) {
+    if (job.complete) {
+        try {
+            job.complete(result, job.payload);
+        } catch (...) {
+            spdlog::error("completion for a job on printer {} threw", _printer_name);
+        }
+    }
+
+    _outstanding.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PrintQueue::run_batch(std::vector<QueuedJob>& batch) {
+    if (batch.size() == 1) {
+        complete(batch.front(), handle(batch.front().payload));
+        return;
+    }
+
+    // One raw stream for the whole batch. Text gets the reset it would
+    // otherwise get as a separate document, ESC/POS documents start with one.
+    constexpr std::string_view RESET = "\x1B\x40";
+
+    std::size_t size = 0;
+    for (auto const& job : batch) {
+        size += job.payload.content.size() + RESET.size();
+    }
+
+    PrintPayload merged{.kind = PayloadKind::EscPos, .content = {}};
+    merged.content.reserve(size);
+    for (auto const& job : batch) {
+        if (job.payload.kind == PayloadKind::Text) {
+            merged.content += RESET;
+        }
+        merged.content += job.payload.content;
+    }
+
+    spdlog::debug("coalesced {} payloads ({} bytes) for printer {}", batch.size(), merged.content.size(),
+        _printer_name);
+
+    // Every payload in the batch shares the outcome of the one job
+    auto const result = handle(merged);
+    for (auto& job : batch) {
+        complete(job, result);
+    }
+}
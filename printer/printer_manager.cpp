@@ -1,329 +1,704 @@
 #include <printer/printer_manager.hpp>
 
-#include <cups/cups.h>
-#include <cups/http.h>
+#include <metrics/metrics.hpp>
+#include <metrics/trace.hpp>
+#include <printer/cups_backend.hpp>
+#include <printer/raster.hpp>
+
 #include <fmt/format.h>
 #include <gsl/assert>
-#include <iterator>
 #include <spdlog/spdlog.h>
 
-#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
-#include <iterator>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <string>
-#include <sys/socket.h>
+#include <string_view>
+#include <system_error>
 #include <utility>
 #include <vector>
 
 namespace {
 
+    namespace metrics = fachory::metrics;
+
+    void reset_printer(BackendJob& job) {
+        FACHORY_TRACE_SCOPE("reset_printer");
+        const char init_sequence[] = "\x1B\x40"; // Reset
 
-    int printer_register_cp(void* user_data, unsigned flags, cups_dest_t* dest) {
-        if (!dest) {
-            return 1;
+        if (job.start_document("init", FORMAT_RAW, false)) {
+            (void)job.write(std::span{init_sequence, sizeof(init_sequence) - 1});
+            job.finish_document();
         }
+    }
 
-        auto manager = static_cast<PrinterManager*>(user_data);
+    // Files are streamed to the printer in chunks of this size, so memory
+    // use doesn't depend on the size of the document
+    constexpr std::size_t STREAM_CHUNK_SIZE = 64 * 1024;
 
-        if (flags & CUPS_DEST_FLAGS_REMOVED) {
-            spdlog::info("deregistering printer {}", dest->name);
-            manager->remove_printer(dest->name, dest);
-            return 1;
+    bool send_blob_to_printer(BackendJob& job, std::span<char const> blob) {
+        FACHORY_TRACE_SCOPE("send_blob_to_printer");
+        if (!job.write(blob)) {
+            return false;
         }
 
-        spdlog::info("registering printer {}", dest->name);
-        manager->add_printer(dest->name, dest);
-        // spdlog::info("calling it on dest item{}", dest->name);
-        return 1;
+        metrics::add(metrics::Counter::PrintBytesWritten, blob.size());
+        return true;
     }
 
-    PrinterOptions make_default_options() {
-        int job_id             = 0;
-        int num_options        = 0;
-        cups_option_t* options = NULL;
+    bool stream_file_to_printer(BackendJob& job, std::ifstream& file) {
+        // One buffer per worker thread, reused for every job it prints
+        thread_local std::vector<char> chunk(STREAM_CHUNK_SIZE);
 
-        // Gets all options (thermal printer related)
-        num_options = cupsAddOption(CUPS_MEDIA, CUPS_MEDIA_LETTER, num_options, &options);
-        num_options = cupsAddOption(CUPS_SIDES, CUPS_SIDES_ONE_SIDED, num_options, &options);
-        num_options = cupsAddOption("media", "Roll80mm", num_options, &options);
-        num_options = cupsAddOption("orientation-requested", "3", num_options, &options);
+        while (file) {
+            file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            auto const read = static_cast<std::size_t>(file.gcount());
+            if (read == 0) {
+                break;
+            }
 
-        auto const options_size = std::make_shared<int>(num_options);
-        PrinterOptionBuffer options_buffer{
-         options, [&options_size](auto* ptr) { cupsFreeOptions(*options_size, ptr); }};
+            if (!send_blob_to_printer(job, std::span{chunk.data(), read})) {
+                return false;
+            }
+        }
 
-        return {std::move(options_buffer), options_size};
+        return !file.bad();
     }
 
-    void reset_printer(cups_dest_t* dest, cups_dinfo_t* info, int job_id, PrinterOptions const& options) {
-        const char init_sequence[] = "\x1B\x40"; // Reset
-        auto const init_doc        = cupsStartDestDocument(
-            CUPS_HTTP_DEFAULT, dest, info, job_id, "init", CUPS_FORMAT_RAW, *options.second, options.first.get(), 0);
+    // Cached payloads are keyed by what identifies the source file, so a hit
+    // needs a stat() but no read. Any change to the file changes the key.
+    std::optional<PayloadKey> file_payload_key(std::string const& path, std::string_view rendering) {
+        std::error_code error;
+        auto const size = std::filesystem::file_size(path, error);
+        if (error) {
+            return std::nullopt;
+        }
 
-        if (init_doc == HTTP_STATUS_CONTINUE) {
-            cupsWriteRequestData(CUPS_HTTP_DEFAULT, init_sequence, sizeof(init_sequence) - 1);
-            cupsFinishDestDocument(CUPS_HTTP_DEFAULT, dest, info);
+        auto const modified = std::filesystem::last_write_time(path, error);
+        if (error) {
+            return std::nullopt;
         }
-    }
 
-    std::optional<std::vector<char>> read_file_contents(std::string const& file_name) {
-        std::ifstream file_stream{file_name};
-        std::vector<char> const all_contents{std::istreambuf_iterator<char>{file_stream}, {}};
-        return std::make_optional(std::move(all_contents));
+        return PayloadHasher{}
+            .add(rendering)
+            .add(std::filesystem::absolute(path, error).string())
+            .add(static_cast<std::uint64_t>(size))
+            .add(static_cast<std::uint64_t>(modified.time_since_epoch().count()))
+            .key();
     }
 
-    bool send_blob_to_printer(std::vector<char> const& blob) {
-        auto const write_res = cupsWriteRequestData(CUPS_HTTP_DEFAULT, blob.data(), blob.size());
-        if (write_res != HTTP_STATUS_CONTINUE) {
-            return false;
+    std::optional<std::vector<std::byte>> read_file_contents(std::ifstream& file, std::size_t size) {
+        std::vector<std::byte> contents(size);
+        if (!file.read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(size))) {
+            return std::nullopt;
         }
 
-        return true;
+        return std::make_optional(std::move(contents));
     }
 
-    struct TempFile {
-        TempFile(std::string filename)
-            : filename{filename} {}
+    // Every failed print ends up here, whether it got as far as a job or not
+    JobResult job_failure(std::string const& printer_name, int job_id, std::string error) {
+        metrics::add(metrics::Counter::PrintJobsFailed);
+        return JobResult{.success = false, .printer_name = printer_name, .job_id = job_id, .error = std::move(error)};
+    }
 
-        ~TempFile() {
-            std::filesystem::remove(filename);
-        }
+    std::future<JobResult> failed_future(JobResult result) {
+        std::promise<JobResult> promise;
+        promise.set_value(std::move(result));
+        return promise.get_future();
+    }
+} // namespace
 
-        std::string filename;
-    };
+PrinterManager::PrinterManager(PrinterManagerConfig config)
+    : _snapshot{std::make_shared<PrinterSnapshot const>(std::vector<PrinterEntry>{}, 0)},
+      _discovery_interval{config.discovery_interval}, _discovery_timeout{config.discovery_timeout}, _discovered{false},
+      _backend{config.backend ? std::move(config.backend) : std::make_shared<CupsBackend>()},
+      _cache{config.cache_budget, std::move(config.cache_spill_directory), config.cache_spill_budget},
+      _monitor{*_backend, config.job_poll_interval, config.job_max_age},
+      _queue_capacity{config.queue_capacity}, _coalescing{config.coalescing}, _queues{}, _shutting_down{false},
+      _pools{}, _jobs_created{0},
+      _discovery{[this](std::stop_token stop) { discover(std::move(stop)); }} {}
 
-    TempFile create_temp_file(std::string const& contents) {
-        namespace fs = std::filesystem;
+PrinterManager::~PrinterManager() {
+    _discovery.request_stop();
+    if (_discovery.joinable()) {
+        _discovery.join();
+    }
+
+    // Drain the workers before the connections they print over go away.
+    // They are destroyed outside the lock, a pool job failing over while
+    // draining needs it to find out we are shutting down.
+    std::map<std::string, std::shared_ptr<PrintQueue>> queues;
+    {
+        std::scoped_lock lock{_queues_mutex};
+        _shutting_down = true;
+        queues.swap(_queues);
+    }
+    queues.clear();
+}
 
-        fs::path temp_dir  = fs::temp_directory_path();
-        fs::path temp_file = temp_dir / (std::tmpnam(nullptr));
+void PrinterManager::discover(std::stop_token stop) {
+    while (!stop.stop_requested()) {
+        poll_destinations(stop);
 
-        std::ofstream ofs(temp_file);
-        ofs << contents;
-        ofs.close();
+        {
+            std::scoped_lock lock{_discovery_mutex};
+            _discovered = true;
+        }
+        _discovery_cv.notify_all();
 
-        return TempFile{temp_file};
+        std::unique_lock lock{_discovery_mutex};
+        _discovery_cv.wait_for(lock, stop, _discovery_interval, [] { return false; });
     }
-} // namespace
-
-PrinterJob::PrinterJob(std::string const& printer_name, cups_dest_t* dest, cups_dinfo_t* info,
-    std::string const& job_name, PrinterOptions const& options)
-    : job_id{0}, printer_name{printer_name}, _cancelled(false), _cups_dest{dest}, _cups_info{info} {
+}
 
+void PrinterManager::poll_destinations(std::stop_token const& stop) {
+    auto discovered = _backend->discover(_discovery_timeout, stop, *_snapshot.load(std::memory_order_acquire));
+    if (!discovered) {
+        return;
+    }
 
-    auto const job_res = cupsCreateDestJob(
-        CUPS_HTTP_DEFAULT, _cups_dest, info, &job_id, job_name.c_str(), *options.second, options.first.get());
+    std::sort(begin(*discovered), end(*discovered),
+        [](auto const& lhs, auto const& rhs) { return lhs.details.name < rhs.details.name; });
 
-    if (job_res != IPP_STATUS_OK) {
-        spdlog::error("unable to create job for printer {}: {}", printer_name, cupsLastErrorString());
-        job_id = 0;
+    std::vector<std::string> names;
+    names.reserve(discovered->size());
+    for (auto const& entry : *discovered) {
+        names.push_back(entry.details.name);
     }
-}
 
-PrinterJob::~PrinterJob() {
-    if (_cancelled) {
-        cupsCancelJob2(CUPS_HTTP_DEFAULT, printer_name.c_str(), job_id, 0);
+    std::scoped_lock lock{_snapshot_write_mutex};
+    auto const current = _snapshot.load(std::memory_order_acquire);
+    if (current->generation() != 0 && current->same_printers(names)) {
         return;
     }
 
-    if (cupsFinishDestDocument(CUPS_HTTP_DEFAULT, _cups_dest, _cups_info) == IPP_STATUS_OK) {
-        spdlog::info("job succeeded for printer {}", printer_name);
-    } else {
-        spdlog::error("job failed for printer {}", printer_name);
+    for (auto const& entry : *discovered) {
+        if (!current->find(entry.details.name)) {
+            spdlog::info("registering printer {}", entry.details.name);
+        }
     }
-}
 
-void PrinterJob::cancel() {
-    _cancelled = true;
+    for (auto const& entry : current->printers()) {
+        if (!std::binary_search(begin(names), end(names), entry.details.name)) {
+            spdlog::info("deregistering printer {}", entry.details.name);
+            _backend->forget(entry.details.name);
+        }
+    }
+
+    publish(std::move(*discovered));
 }
 
-PrinterManager::PrinterManager()
-    : _printer_details{}, _cups_dests_indices{}, _cups_dests_array{nullptr}, _cups_num_dests(0) {
-    poll_destinations();
+void PrinterManager::publish(std::vector<PrinterEntry> printers) {
+    auto const generation = _snapshot.load(std::memory_order_relaxed)->generation() + 1;
+    auto snapshot         = std::make_shared<PrinterSnapshot const>(std::move(printers), generation);
+    _snapshot.store(std::move(snapshot), std::memory_order_release);
 }
 
-PrinterManager::~PrinterManager() {
-    _printer_details.clear();
-    cupsFreeDests(_cups_num_dests, _cups_dests_array);
+bool PrinterManager::wait_for_printers(std::chrono::milliseconds timeout) const {
+    std::unique_lock lock{_discovery_mutex};
+    return _discovery_cv.wait_for(lock, timeout, [this] { return _discovered; });
+}
 
-    for (auto [name, info] : _infos) {
-        cupsFreeDestInfo(info);
+void PrinterManager::add_printer(PrinterEntry entry) {
+    if (!entry.handle) {
+        spdlog::error("invalid entry for added printer {}, skipping", entry.details.name);
+        return;
     }
+
+    std::scoped_lock lock{_snapshot_write_mutex};
+    auto printers = _snapshot.load(std::memory_order_acquire)->printers();
+    std::erase_if(printers, [&entry](auto const& printer) { return printer.details.name == entry.details.name; });
+    printers.push_back(std::move(entry));
+    publish(std::move(printers));
 }
 
-void PrinterManager::poll_destinations() {
-    cupsEnumDests(CUPS_DEST_FLAGS_NONE, 1000, NULL, 0, 0, printer_register_cp, this);
+void PrinterManager::remove_printer(std::string const& name) {
+    {
+        std::scoped_lock lock{_snapshot_write_mutex};
+        auto printers = _snapshot.load(std::memory_order_acquire)->printers();
+        std::erase_if(printers, [&name](auto const& printer) { return printer.details.name == name; });
+        publish(std::move(printers));
+    }
 
-    std::map<std::string, int> new_map_indices{};
-    for (int i = 0; i < _cups_num_dests; ++i) {
-        auto dest                  = _cups_dests_array[i];
-        new_map_indices[dest.name] = i;
+    _backend->forget(name);
+}
+
+std::shared_ptr<PrinterEntry const> PrinterManager::query_printer(std::string const& printer_name) const {
+    FACHORY_TRACE_SCOPE("query_printer");
+    auto snapshot     = _snapshot.load(std::memory_order_acquire);
+    auto const* entry = snapshot->find(printer_name);
+    if (!entry) {
+        spdlog::error("printer {} is not registered", printer_name);
+        return nullptr;
     }
-    _cups_dests_indices = std::move(new_map_indices);
+
+    Expects(entry->handle);
+
+    // Shares ownership of the whole snapshot, so the entry stays valid for
+    // as long as the caller needs it even if discovery replaces it
+    return std::shared_ptr<PrinterEntry const>{std::move(snapshot), entry};
 }
 
-void PrinterManager::add_printer(std::string const& name, cups_dest_t* dest) {
-    if (!dest) {
-        spdlog::error("invalid destination for added printer, skipping");
-        return;
+std::unique_ptr<BackendJob> PrinterManager::create_printer_job(
+    PrinterEntry const& printer, std::string const& job_name) {
+    FACHORY_TRACE_SCOPE("create_printer_job");
+    metrics::ScopedTimer timer{metrics::Timer::PrintJobCreate};
+
+    auto job = _backend->create_job(printer, job_name);
+    if (!job) {
+        return nullptr;
     }
 
-    int const prev_num_dests = _cups_num_dests;
+    _jobs_created.fetch_add(1, std::memory_order_relaxed);
+    metrics::add(metrics::Counter::PrintJobsCreated);
+    return job;
+}
 
-    _cups_num_dests = cupsCopyDest(dest, _cups_num_dests, &_cups_dests_array);
+JobResult PrinterManager::print_document(std::string const& printer_name, std::string const& document_name,
+    std::string const& format, DocumentWriter const& write_document, bool reset_first) {
+    FACHORY_TRACE_SCOPE("print_document");
 
-    if (prev_num_dests == _cups_num_dests) {
-        spdlog::error("destination was not added by cups");
-        return;
+    // Held until the job is done, keeping the printer's handle alive
+    auto const printer = query_printer(printer_name);
+    if (!printer) {
+        return job_failure(printer_name, 0, fmt::format("printer {} is not registered", printer_name));
     }
 
-    _infos[name] = cupsCopyDestInfo(CUPS_HTTP_DEFAULT, dest);
+    auto job = create_printer_job(*printer, "My Job");
+    if (!job) {
+        auto error = _backend->last_error();
+        spdlog::error("could not create job for printer {}: {}", printer_name, error);
+        return job_failure(printer_name, 0, std::move(error));
+    }
 
-    _cups_dests_indices[name] = _cups_num_dests - 1;
+    if (reset_first) {
+        reset_printer(*job);
+    }
 
-    _printer_details[name] = PrinterDetails{.name = dest->name,
-     .instance                                    = dest->instance != nullptr ? dest->instance : "",
-     .is_default                                  = static_cast<bool>(dest->is_default),
-     .options                                     = {}};
-}
+    // Start, write and finish follow each other, so one reading ends a stage
+    // and starts the next
+    metrics::StageTimer stages;
+
+    auto const started = [&] {
+        FACHORY_TRACE_SCOPE("start_document");
+        return job->start_document(document_name, format, true);
+    }();
+    stages.lap(metrics::Timer::PrintDocumentStart);
+    if (!started) {
+        auto error = _backend->last_error();
+        spdlog::error("unable to start the document for printer {}: {}", printer_name, error);
+        job->cancel();
+        return job_failure(printer_name, job->id(), std::move(error));
+    }
 
-void PrinterManager::remove_printer(std::string const& name, cups_dest_t* dest) {
-    if (!dest) {
-        spdlog::error("invalid destination for removed printer, skippint");
-        return;
+    auto const written = write_document(*job);
+    stages.lap(metrics::Timer::PrintDocumentWrite);
+    if (!written) {
+        auto error = _backend->last_error();
+        spdlog::error("could not write {} to printer: {}", document_name, error);
+        job->cancel();
+        return job_failure(printer_name, job->id(), std::move(error));
     }
 
-    auto const found = _printer_details.find(name);
-    if (found != end(_printer_details)) {
-        _printer_details.erase(found);
+    // Finishing is timed on its own, it is where the backend waits for the
+    // printer to accept the document
+    auto const finished = [&] {
+        FACHORY_TRACE_SCOPE("finish_job");
+        return job->finish_document();
+    }();
+    stages.lap(metrics::Timer::PrintJobFinish);
+    if (!finished) {
+        auto error = _backend->last_error();
+        spdlog::error("printer {} did not accept {}: {}", printer_name, document_name, error);
+        job->cancel();
+        return job_failure(printer_name, job->id(), std::move(error));
     }
 
-    _cups_num_dests = cupsRemoveDest(dest->name, dest->instance, _cups_num_dests, &_cups_dests_array);
-    _printer_details.erase(dest->name);
-    _infos.erase(dest->name);
+    return JobResult{.success = true, .printer_name = printer_name, .job_id = job->id(), .error = {}};
 }
 
-std::optional<std::pair<cups_dest_t*, cups_dinfo_t*>> PrinterManager::query_printer(std::string const& printer_name) {
+JobResult PrinterManager::print_file(
+    std::string const& printer_name, std::string const& file_path, std::string const& format) {
 
-    auto const dest_index_found = _cups_dests_indices.find(printer_name);
-    if (dest_index_found == end(_cups_dests_indices)) {
-        spdlog::error("printer {} is not registered", printer_name);
-        return std::nullopt;
+    auto const key = file_payload_key(file_path, format);
+    if (key) {
+        if (auto const cached = _cache.find(*key)) {
+            return print_buffer(printer_name, *cached, format);
+        }
+    }
+
+    std::ifstream file{file_path, std::ios::binary};
+    if (!file) {
+        spdlog::error("could not open file {} for printing", file_path);
+        return job_failure(printer_name, 0, fmt::format("could not open file {}", file_path));
     }
 
-    auto const dest = _cups_dests_array + dest_index_found->second;
-    Expects(dest);
+    // Small enough files are read whole so the next print is a cache hit,
+    // everything else is streamed
+    std::error_code error;
+    auto const size = std::filesystem::file_size(file_path, error);
+    if (key && !error && _cache.fits(size)) {
+        if (auto contents = read_file_contents(file, size)) {
+            auto const payload = _cache.insert(*key, std::move(*contents));
+            return print_buffer(printer_name, *payload, format);
+        }
 
-    // Find the printer info
-    auto const info_found = _infos.find(printer_name);
-    if (info_found == end(_infos)) {
-        spdlog::error("could not find info for printer {}", printer_name);
-        return std::nullopt;
+        file.clear();
+        file.seekg(0);
     }
 
-    return std::make_optional<std::pair<cups_dest_t*, cups_dinfo_t*>>(dest, info_found->second);
+    return print_document(
+        printer_name, file_path, format, [&file](BackendJob& job) { return stream_file_to_printer(job, file); });
 }
 
-std::optional<PrinterJob> PrinterManager::create_printer_job(
-    std::string const& printer_name, std::string const& job_name, PrinterOptions const& options) {
-    auto const maybe_printer = query_printer(printer_name);
-    if (!maybe_printer) {
-        return std::nullopt;
-    }
-    auto [dest, info] = *maybe_printer;
+JobResult PrinterManager::print_buffer(std::string const& printer_name, std::span<std::byte const> bytes,
+    std::string const& format, bool reset_first) {
+    auto const blob = std::span{reinterpret_cast<char const*>(bytes.data()), bytes.size()};
 
-    int job_id = 0;
+    auto const write_blob = [blob](BackendJob& job) { return send_blob_to_printer(job, blob); };
+    return print_document(printer_name, "buffer", format, write_blob, reset_first);
+}
 
-    auto const job_res =
-        cupsCreateDestJob(CUPS_HTTP_DEFAULT, dest, info, &job_id, "My Job", *options.second, options.first.get());
+JobResult PrinterManager::print_image(std::string const& printer_name, std::string const& image_path) {
+    RasterOptions const options{};
+    auto const rendering = fmt::format("escpos-raster:{}:{}", options.width, static_cast<int>(options.dither));
 
-    if (job_res != IPP_STATUS_OK) {
-        return std::nullopt;
+    auto const key = file_payload_key(image_path, rendering);
+    if (key) {
+        if (auto const cached = _cache.find(*key)) {
+            return print_buffer(printer_name, *cached, FORMAT_RAW, false);
+        }
     }
 
-    return std::make_optional<PrinterJob>(printer_name, dest, info, job_name.c_str(), options);
-}
+    auto const maybe_raster = rasterize_jpeg(image_path, options);
+    if (!maybe_raster) {
+        spdlog::warn("could not rasterize {}, letting the printer render it", image_path);
+        return print_file(printer_name, image_path, FORMAT_JPEG);
+    }
 
-bool PrinterManager::print_file(
-    std::string const& printer_name, std::string const& file_path, std::string const& format) {
+    EscPosDocument document{maybe_raster->bits.size() + EscPosDocument::DEFAULT_CAPACITY};
+    document.align(Alignment::Center).raster_image(*maybe_raster).feed(3).cut();
 
-    auto const maybe_file_contents = read_file_contents(file_path);
-    if (!maybe_file_contents) {
-        spdlog::error("could not open file {} for printing", file_path);
-        return false;
+    if (!key) {
+        return print_buffer(printer_name, document.bytes(), FORMAT_RAW, false);
     }
 
-    auto const maybe_printer = query_printer(printer_name);
-    if (!maybe_printer) {
-        return false;
-    }
-    auto [dest, info]  = *maybe_printer;
-    auto const options = make_default_options();
+    auto const bytes   = document.bytes();
+    auto const payload = _cache.insert(*key, std::vector<std::byte>{begin(bytes), end(bytes)});
+    return print_buffer(printer_name, *payload, FORMAT_RAW, false);
+}
 
-    auto maybe_job = create_printer_job(printer_name, "My Job", options);
-    if (!maybe_job) {
-        spdlog::error("could not create job for printer {}: {}", printer_name, cupsLastErrorString());
+bool PrinterManager::print_pdf(std::string const& printer_name, std::string const& pdf_path) {
+    if (!print_file(printer_name, pdf_path, FORMAT_PDF).success) {
+        spdlog::error("failed to print pdf file {}", pdf_path);
         return false;
     }
 
-    reset_printer(dest, info, maybe_job->job_id, options);
-
-    auto const start_doc_res = cupsStartDestDocument(CUPS_HTTP_DEFAULT, dest, info, maybe_job->job_id,
-        file_path.c_str(), format.c_str(), *options.second, options.first.get(), 1);
+    return true;
+}
 
-    if (HTTP_STATUS_CONTINUE != start_doc_res) {
-        spdlog::error("unable to start the document for printer {}: {}", printer_name, cupsLastErrorString());
-        maybe_job->cancel();
+bool PrinterManager::print_jpeg(std::string const& printer_name, std::string const& image_path) {
+    if (!print_image(printer_name, image_path).success) {
+        spdlog::error("failed to print jpeg file {}", image_path);
         return false;
     }
 
-    if (!send_blob_to_printer(*maybe_file_contents)) {
-        spdlog::error("could not write blob to printer: {}", cupsLastErrorString());
+    return true;
+}
+
+bool PrinterManager::print_text(std::string const& printer_name, std::string_view text) {
+    if (!print_buffer(printer_name, std::as_bytes(std::span{text}), FORMAT_RAW).success) {
+        spdlog::error("failed to print text");
         return false;
     }
 
     return true;
 }
 
-bool PrinterManager::print_pdf(std::string const& printer_name, std::string const& pdf_path) {
-    if (print_file(printer_name, pdf_path, CUPS_FORMAT_PDF)) {
-        spdlog::error("failed to print pdf file {}", pdf_path);
+bool PrinterManager::print_bytes(std::string const& printer_name, std::span<std::byte const> bytes) {
+    if (!print_buffer(printer_name, bytes, FORMAT_RAW).success) {
+        spdlog::error("failed to print {} bytes", bytes.size());
         return false;
     }
 
     return true;
 }
 
-bool PrinterManager::print_jpeg(std::string const& printer_name, std::string const& image_path) {
-    if (print_file(printer_name, image_path, CUPS_FORMAT_JPEG)) {
-        spdlog::error("failed to print jpeg file {}", image_path);
+bool PrinterManager::print_escpos(std::string const& printer_name, EscPosDocument const& document) {
+    if (!print_buffer(printer_name, document.bytes(), FORMAT_RAW, false).success) {
+        spdlog::error("failed to print escpos document");
         return false;
     }
 
     return true;
 }
 
-bool PrinterManager::print_text(std::string const& printer_name, std::string const& text) {
+std::future<JobResult> PrinterManager::submit(std::string const& printer_name, PrintPayload payload) {
+    auto const queue = queue_for(printer_name);
+    if (!queue) {
+        return failed_future(job_failure(printer_name, 0, queue_error(printer_name)));
+    }
 
-    auto const file = create_temp_file(text);
+    return queue->submit(std::move(payload));
+}
 
-    if (print_file(printer_name, file.filename, CUPS_FORMAT_RAW)) {
-        spdlog::error("failed to print text");
+std::optional<std::future<JobResult>> PrinterManager::try_submit(
+    std::string const& printer_name, PrintPayload payload) {
+    auto const queue = queue_for(printer_name);
+    if (!queue) {
+        if (shutting_down()) {
+            return std::nullopt;
+        }
+
+        return failed_future(job_failure(printer_name, 0, queue_error(printer_name)));
+    }
+
+    return queue->try_submit(std::move(payload));
+}
+
+std::shared_ptr<PrintQueue> PrinterManager::queue_for(std::string const& printer_name) {
+    std::scoped_lock lock{_queues_mutex};
+    if (_shutting_down) {
+        return nullptr;
+    }
+
+    auto found = _queues.find(printer_name);
+    if (found == end(_queues)) {
+        // A worker per typo would never go away again
+        if (!_snapshot.load(std::memory_order_acquire)->find(printer_name)) {
+            spdlog::error("printer {} is not registered", printer_name);
+            return nullptr;
+        }
+
+        spdlog::info("starting print queue for printer {}", printer_name);
+        auto queue = std::make_shared<PrintQueue>(printer_name, _queue_capacity,
+            [this](std::string const& name, PrintPayload const& payload) { return run_job(name, payload); },
+            _coalescing);
+        found      = _queues.emplace(printer_name, std::move(queue)).first;
+    }
+
+    return found->second;
+}
+
+bool PrinterManager::shutting_down() {
+    std::scoped_lock lock{_queues_mutex};
+    return _shutting_down;
+}
+
+std::string PrinterManager::queue_error(std::string const& printer_name) {
+    return shutting_down() ? std::string{"printer manager is shutting down"}
+                           : fmt::format("printer {} is not registered", printer_name);
+}
+
+std::shared_ptr<PrintQueue> PrinterManager::find_queue(std::string const& printer_name) {
+    std::scoped_lock lock{_queues_mutex};
+    auto const found = _queues.find(printer_name);
+    return found == end(_queues) ? nullptr : found->second;
+}
+
+// One pool job on its way through the members. Only ever touched by one
+// thread at a time: the submitter, then each worker the job lands on.
+struct PrinterManager::PoolDispatch {
+    std::string pool_name;
+    std::vector<std::string> remaining;
+    std::optional<JobResult> last_failure;
+    std::promise<JobResult> promise;
+};
+
+bool PrinterManager::create_pool(std::string const& pool_name, std::vector<std::string> printers, PoolPolicy policy) {
+    if (printers.empty()) {
+        spdlog::error("pool {} needs at least one printer", pool_name);
         return false;
     }
 
-    return true;
+    std::scoped_lock lock{_pools_mutex};
+    auto pool             = std::make_shared<PrinterPool>(pool_name, std::move(printers), policy);
+    auto const [_, added] = _pools.try_emplace(pool_name, std::move(pool));
+    if (!added) {
+        spdlog::error("pool {} already exists", pool_name);
+    }
+
+    return added;
 }
 
+bool PrinterManager::remove_pool(std::string const& pool_name) {
+    std::scoped_lock lock{_pools_mutex};
+    return _pools.erase(pool_name) > 0;
+}
+
+std::future<JobResult> PrinterManager::submit_to_pool(std::string const& pool_name, PrintPayload payload) {
+    std::shared_ptr<PrinterPool> pool;
+    {
+        std::scoped_lock lock{_pools_mutex};
+        auto const found = _pools.find(pool_name);
+        if (found != end(_pools)) {
+            pool = found->second;
+        }
+    }
+
+    if (!pool) {
+        spdlog::error("pool {} does not exist", pool_name);
+        return failed_future(job_failure({}, 0, fmt::format("pool {} does not exist", pool_name)));
+    }
+
+    auto const snapshot = _snapshot.load(std::memory_order_acquire);
+
+    std::vector<MemberLoad> loads;
+    loads.reserve(pool->members().size());
+    for (auto const& member : pool->members()) {
+        auto const queue = find_queue(member);
+        loads.push_back(MemberLoad{.name = member,
+         .available                      = snapshot->find(member) != nullptr,
+         .outstanding                    = queue ? queue->outstanding() : 0,
+         .seconds_per_job                = queue ? queue->seconds_per_job() : 0.0});
+    }
+
+    auto dispatch       = std::make_shared<PoolDispatch>();
+    dispatch->pool_name = pool_name;
+    dispatch->remaining = pool->rank(loads);
+    auto future         = dispatch->promise.get_future();
+
+    dispatch_pool_job(dispatch, std::move(payload), true);
+    return future;
+}
+
+void PrinterManager::dispatch_pool_job(
+    std::shared_ptr<PoolDispatch> const& dispatch, PrintPayload payload, bool may_block) {
+    auto const snapshot = _snapshot.load(std::memory_order_acquire);
+    std::erase_if(dispatch->remaining, [&](std::string const& name) {
+        if (snapshot->find(name)) {
+            return false;
+        }
+
+        spdlog::warn("printer {} in pool {} is gone, skipping it", name, dispatch->pool_name);
+        return true;
+    });
+
+    PrintQueue::Completion complete = [this, dispatch](JobResult const& result, PrintPayload& failed) {
+        if (result.success) {
+            dispatch->promise.set_value(result);
+            return;
+        }
+
+        spdlog::warn("job in pool {} failed on printer {}: {}", dispatch->pool_name, result.printer_name, result.error);
+        dispatch->last_failure = result;
+
+        // Runs on the failed printer's worker, which must not block on
+        // another printer's full queue
+        dispatch_pool_job(dispatch, std::move(failed), false);
+    };
+
+    // Best candidate with room first, so a busy printer doesn't hold the
+    // job back while another one is idle
+    for (std::size_t index = 0; index < dispatch->remaining.size();) {
+        auto const member = begin(dispatch->remaining) + static_cast<std::ptrdiff_t>(index);
+        auto const queue  = queue_for(*member);
+        if (!queue) {
+            if (shutting_down()) {
+                dispatch->promise.set_value(job_failure(*member, 0, "printer manager is shutting down"));
+                return;
+            }
+
+            // Dropped out of discovery since the members were filtered above
+            dispatch->remaining.erase(member);
+            continue;
+        }
+
+        // Once queued, the job may fail over on that worker straight away,
+        // so the member has to be off the list before it is handed over
+        auto name = std::move(*member);
+        dispatch->remaining.erase(member);
+        if (queue->try_enqueue(payload, complete)) {
+            return;
+        }
+
+        dispatch->remaining.insert(begin(dispatch->remaining) + static_cast<std::ptrdiff_t>(index), std::move(name));
+        ++index;
+    }
+
+    if (may_block && !dispatch->remaining.empty()) {
+        auto const queue = queue_for(dispatch->remaining.front());
+        dispatch->remaining.erase(begin(dispatch->remaining));
+        if (queue) {
+            queue->enqueue(std::move(payload), std::move(complete));
+            return;
+        }
+    }
+
+    if (dispatch->last_failure) {
+        dispatch->promise.set_value(std::move(*dispatch->last_failure));
+        return;
+    }
+
+    spdlog::error("no printer in pool {} could take the job", dispatch->pool_name);
+    dispatch->promise.set_value(
+        job_failure({}, 0, fmt::format("no printer in pool {} could take the job", dispatch->pool_name)));
+}
+
+JobResult PrinterManager::run_job(std::string const& printer_name, PrintPayload const& payload) {
+    switch (payload.kind) {
+    case PayloadKind::Pdf:
+        return print_file(printer_name, payload.content, FORMAT_PDF);
+    case PayloadKind::Jpeg:
+        return print_image(printer_name, payload.content);
+    case PayloadKind::Text:
+        return print_buffer(printer_name, std::as_bytes(std::span{payload.content}), FORMAT_RAW);
+    case PayloadKind::EscPos:
+        return print_buffer(printer_name, std::as_bytes(std::span{payload.content}), FORMAT_RAW, false);
+    }
+
+    return job_failure(printer_name, 0, "unknown payload kind");
+}
+
+
+std::future<JobCompletion> PrinterManager::track_job(JobResult const& result) {
+    auto promise = std::make_shared<std::promise<JobCompletion>>();
+    auto future  = promise->get_future();
+
+    track_job(result, [promise](JobCompletion const& completion) { promise->set_value(completion); });
+    return future;
+}
+
+void PrinterManager::track_job(JobResult const& result, JobMonitor::Callback callback) {
+    if (!result.success || result.job_id == 0) {
+        callback(JobCompletion{.printer_name = result.printer_name,
+         .job_id                             = result.job_id,
+         .state                              = JobState::Aborted,
+         .created                            = {},
+         .processing                         = {},
+         .completed                          = {}});
+        return;
+    }
+
+    _monitor.watch(result.printer_name, result.job_id, std::move(callback));
+}
+
+CacheStats PrinterManager::cache_stats() const {
+    return _cache.stats();
+}
+
+std::uint64_t PrinterManager::jobs_created() const {
+    return _jobs_created.load(std::memory_order_relaxed);
+}
 
 std::vector<std::string> PrinterManager::printers() const {
+    auto const snapshot = _snapshot.load(std::memory_order_acquire);
+
     std::vector<std::string> all_printers;
-    for (auto [name, details] : _printer_details) {
-        spdlog::info("calling it on map item ({}, {})", name, details.instance);
-        all_printers.push_back(name);
+    all_printers.reserve(snapshot->printers().size());
+    for (auto const& [details, handle] : snapshot->printers()) {
+        spdlog::debug("listing printer ({}, {})", details.name, details.instance);
+        all_printers.push_back(details.name);
     }
 
     return all_printers;
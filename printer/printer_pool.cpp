@@ -0,0 +1,63 @@
+#include <printer/printer_pool.hpp>
+
+#include <algorithm>
+#include <utility>
+
+PrinterPool::PrinterPool(std::string name, std::vector<std::string> members, PoolPolicy policy)
+    : _name{std::move(name)}, _members{std::move(members)}, _policy{policy}, _cursor{0} {}
+
+std::string const& PrinterPool::name() const {
+    return _name;
+}
+
+std::vector<std::string> const& PrinterPool::members() const {
+    return _members;
+}
+
+PoolPolicy PrinterPool::policy() const {
+    return _policy;
+}
+
+std::vector<std::string> PrinterPool::rank(std::span<MemberLoad const> loads) {
+    std::vector<MemberLoad> candidates;
+    candidates.reserve(loads.size());
+
+    // Round-robin rotates the starting member, the other policies keep the
+    // configured order to break ties
+    auto const start = _policy == PoolPolicy::RoundRobin && !loads.empty()
+                         ? _cursor.fetch_add(1, std::memory_order_relaxed) % loads.size()
+                         : 0;
+    for (std::size_t i = 0; i < loads.size(); ++i) {
+        auto const& load = loads[(start + i) % loads.size()];
+        if (load.available) {
+            candidates.push_back(load);
+        }
+    }
+
+    switch (_policy) {
+    case PoolPolicy::LeastOutstanding:
+        std::stable_sort(begin(candidates), end(candidates),
+            [](MemberLoad const& lhs, MemberLoad const& rhs) { return lhs.outstanding < rhs.outstanding; });
+        break;
+    case PoolPolicy::WeightedThroughput: {
+        // Expected time until a new job would be done. Printers that haven't
+        // finished a job yet count as free, so they get measured.
+        auto const expected_wait = [](MemberLoad const& load) {
+            return static_cast<double>(load.outstanding + 1) * load.seconds_per_job;
+        };
+        std::stable_sort(begin(candidates), end(candidates),
+            [&](MemberLoad const& lhs, MemberLoad const& rhs) { return expected_wait(lhs) < expected_wait(rhs); });
+        break;
+    }
+    case PoolPolicy::RoundRobin:
+        break;
+    }
+
+    std::vector<std::string> ranked;
+    ranked.reserve(candidates.size());
+    for (auto const& candidate : candidates) {
+        ranked.emplace_back(candidate.name);
+    }
+
+    return ranked;
+}
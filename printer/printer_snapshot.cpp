@@ -0,0 +1,34 @@
+#include <printer/printer_snapshot.hpp>
+
+#include <algorithm>
+#include <utility>
+
+PrinterSnapshot::PrinterSnapshot(std::vector<PrinterEntry> printers, std::uint64_t generation)
+    : _printers{std::move(printers)}, _generation{generation} {
+    std::sort(begin(_printers), end(_printers),
+        [](auto const& lhs, auto const& rhs) { return lhs.details.name < rhs.details.name; });
+}
+
+PrinterEntry const* PrinterSnapshot::find(std::string_view name) const {
+    auto const found = std::lower_bound(begin(_printers), end(_printers), name,
+        [](PrinterEntry const& entry, std::string_view name) { return entry.details.name < name; });
+
+    if (found == end(_printers) || found->details.name != name) {
+        return nullptr;
+    }
+
+    return &*found;
+}
+
+std::vector<PrinterEntry> const& PrinterSnapshot::printers() const {
+    return _printers;
+}
+
+std::uint64_t PrinterSnapshot::generation() const {
+    return _generation;
+}
+
+bool PrinterSnapshot::same_printers(std::vector<std::string> const& sorted_names) const {
+    return std::equal(begin(_printers), end(_printers), begin(sorted_names), end(sorted_names),
+        [](PrinterEntry const& entry, std::string const& name) { return entry.details.name == name; });
+}
@@ -0,0 +1,354 @@
+#include <printer/raster.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+
+#include <jpeglib.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FACHORY_RASTER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    struct JpegErrorManager {
+        jpeg_error_mgr manager;
+        std::jmp_buf jump;
+    };
+
+    void on_jpeg_error(j_common_ptr cinfo) {
+        std::array<char, JMSG_LENGTH_MAX> message{};
+        (*cinfo->err->format_message)(cinfo, message.data());
+        spdlog::error("could not decode jpeg: {}", message.data());
+
+        std::longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+    }
+
+    // libjpeg reports errors with longjmp, so nothing with a destructor may
+    // live in this frame. The image is owned by the caller.
+    bool decompress(jpeg_decompress_struct& cinfo, std::FILE* file, std::span<std::byte const> memory,
+        std::size_t min_width, GrayImage* image) {
+        if (setjmp(reinterpret_cast<JpegErrorManager*>(cinfo.err)->jump)) {
+            return false;
+        }
+
+        if (file) {
+            jpeg_stdio_src(&cinfo, file);
+        } else {
+            jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char const*>(memory.data()),
+                static_cast<unsigned long>(memory.size()));
+        }
+
+        jpeg_read_header(&cinfo, TRUE);
+
+        // Luma only, no colour conversion needed
+        cinfo.out_color_space = JCS_GRAYSCALE;
+
+        // Let the IDCT do the bulk of the downscaling for free
+        cinfo.scale_num   = 1;
+        cinfo.scale_denom = 1;
+        for (unsigned denom : {8u, 4u, 2u}) {
+            if ((cinfo.image_width + denom - 1) / denom >= min_width) {
+                cinfo.scale_denom = denom;
+                break;
+            }
+        }
+
+        jpeg_start_decompress(&cinfo);
+
+        image->width  = cinfo.output_width;
+        image->height = cinfo.output_height;
+        image->pixels.resize(image->width * image->height);
+
+        while (cinfo.output_scanline < cinfo.output_height) {
+            JSAMPROW row = image->pixels.data() + static_cast<std::size_t>(cinfo.output_scanline) * image->width;
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+
+        jpeg_finish_decompress(&cinfo);
+        return true;
+    }
+
+    std::optional<GrayImage> decode(std::FILE* file, std::span<std::byte const> memory, std::size_t min_width) {
+        jpeg_decompress_struct cinfo{};
+        JpegErrorManager errors{};
+
+        cinfo.err                 = jpeg_std_error(&errors.manager);
+        errors.manager.error_exit = on_jpeg_error;
+        jpeg_create_decompress(&cinfo);
+
+        GrayImage image{.width = 0, .height = 0, .pixels = {}};
+        bool const decoded = decompress(cinfo, file, memory, min_width, &image);
+        jpeg_destroy_decompress(&cinfo);
+
+        if (!decoded) {
+            return std::nullopt;
+        }
+
+        return std::make_optional(std::move(image));
+    }
+
+    // 8x8 Bayer matrix scaled so a pixel becomes a dot when it is at most
+    // the entry, spreading the thresholds evenly over 1..253
+    constexpr auto ORDERED_LIMITS = [] {
+        constexpr std::array<std::array<std::uint8_t, 8>, 8> bayer{{
+         {0, 32, 8, 40, 2, 34, 10, 42},
+         {48, 16, 56, 24, 50, 18, 58, 26},
+         {12, 44, 4, 36, 14, 46, 6, 38},
+         {60, 28, 52, 20, 62, 30, 54, 22},
+         {3, 35, 11, 43, 1, 33, 9, 41},
+         {51, 19, 59, 27, 49, 17, 57, 25},
+         {15, 47, 7, 39, 13, 45, 5, 37},
+         {63, 31, 55, 23, 61, 29, 53, 21},
+        }};
+
+        // Each row is repeated to 32 entries so SIMD kernels can load it whole
+        std::array<std::array<std::uint8_t, 32>, 8> limits{};
+        for (std::size_t y = 0; y < 8; ++y) {
+            for (std::size_t x = 0; x < 32; ++x) {
+                limits[y][x] = static_cast<std::uint8_t>(bayer[y][x % 8] * 4 + 1);
+            }
+        }
+        return limits;
+    }();
+
+    RasterImage make_raster(std::size_t width, std::size_t height) {
+        RasterImage raster{.width = width, .height = height, .bits = {}};
+        raster.bits.assign(raster.bytes_per_row() * height, 0);
+        return raster;
+    }
+
+    // Ordered dither for the bytes [first_byte, row_bytes) of a row
+    void dither_ordered_row_scalar(std::uint8_t const* gray, std::size_t width, std::uint8_t const* limits,
+        std::size_t first_byte, std::uint8_t* out) {
+        auto const row_bytes = (width + 7) / 8;
+        for (std::size_t byte = first_byte; byte < row_bytes; ++byte) {
+            std::uint8_t bits = 0;
+            for (std::size_t bit = 0; bit < 8; ++bit) {
+                auto const x = byte * 8 + bit;
+                if (x < width && gray[x] <= limits[x % 32]) {
+                    bits |= static_cast<std::uint8_t>(0x80 >> bit);
+                }
+            }
+            out[byte] = bits;
+        }
+    }
+
+#ifdef FACHORY_RASTER_X86
+    // movemask puts pixel i in bit i, ESC/POS wants the leftmost pixel in
+    // the top bit, so every group of 8 is reversed before the movemask
+    __attribute__((target("ssse3"))) std::size_t dither_ordered_row_sse(
+        std::uint8_t const* gray, std::size_t width, std::uint8_t const* limits, std::uint8_t* out) {
+        auto const reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        auto const limit   = _mm_loadu_si128(reinterpret_cast<__m128i const*>(limits));
+
+        std::size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            auto const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(gray + x));
+            auto const dots   = _mm_cmpeq_epi8(_mm_max_epu8(pixels, limit), limit);
+            auto const mask   = static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_shuffle_epi8(dots, reverse)));
+            std::memcpy(out + x / 8, &mask, sizeof(mask));
+        }
+
+        return x / 8;
+    }
+
+    __attribute__((target("avx2"))) std::size_t dither_ordered_row_avx2(
+        std::uint8_t const* gray, std::size_t width, std::uint8_t const* limits, std::uint8_t* out) {
+        auto const reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+            1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        auto const limit   = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(limits));
+
+        std::size_t x = 0;
+        for (; x + 32 <= width; x += 32) {
+            auto const pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(gray + x));
+            auto const dots   = _mm256_cmpeq_epi8(_mm256_max_epu8(pixels, limit), limit);
+            auto const mask   = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_shuffle_epi8(dots, reverse)));
+            std::memcpy(out + x / 8, &mask, sizeof(mask));
+        }
+
+        return x / 8;
+    }
+#endif
+
+} // namespace
+
+std::size_t RasterImage::bytes_per_row() const {
+    return (width + 7) / 8;
+}
+
+SimdLevel best_simd_level() {
+#ifdef FACHORY_RASTER_X86
+    static SimdLevel const level = [] {
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::Avx2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return SimdLevel::Sse;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+std::optional<GrayImage> decode_jpeg(std::span<std::byte const> jpeg, std::size_t min_width) {
+    if (jpeg.empty()) {
+        spdlog::error("could not decode empty jpeg");
+        return std::nullopt;
+    }
+
+    return decode(nullptr, jpeg, min_width);
+}
+
+std::optional<GrayImage> decode_jpeg_file(std::string const& path, std::size_t min_width) {
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        spdlog::error("could not open jpeg {}", path);
+        return std::nullopt;
+    }
+
+    auto image = decode(file, {}, min_width);
+    std::fclose(file);
+    return image;
+}
+
+GrayImage scale_to_width(GrayImage const& image, std::size_t width) {
+    if (image.width == width || image.width == 0 || image.height == 0 || width == 0) {
+        return image;
+    }
+
+    auto const height = std::max<std::size_t>(1, (image.height * width + image.width / 2) / image.width);
+
+    // Source positions in 24.8 fixed point, sampled at pixel centres
+    auto const source_position = [](std::size_t i, std::size_t from, std::size_t to) {
+        auto const scaled = static_cast<std::int64_t>((2 * i + 1) * from * 256 / (2 * to)) - 128;
+        return std::clamp<std::int64_t>(scaled, 0, static_cast<std::int64_t>(from - 1) * 256);
+    };
+
+    struct Tap {
+        std::size_t first;
+        std::size_t second;
+        std::uint32_t weight;
+    };
+
+    std::vector<Tap> columns(width);
+    for (std::size_t x = 0; x < width; ++x) {
+        auto const position = source_position(x, image.width, width);
+        auto const first    = static_cast<std::size_t>(position >> 8);
+        auto const second   = std::min(first + 1, image.width - 1);
+        columns[x] = Tap{.first = first, .second = second, .weight = static_cast<std::uint32_t>(position & 0xFF)};
+    }
+
+    GrayImage scaled{.width = width, .height = height, .pixels = std::vector<std::uint8_t>(width * height)};
+    std::vector<std::uint32_t> top(width);
+    std::vector<std::uint32_t> bottom(width);
+
+    for (std::size_t y = 0; y < height; ++y) {
+        auto const position = source_position(y, image.height, height);
+        auto const first    = static_cast<std::size_t>(position >> 8);
+        auto const second   = std::min(first + 1, image.height - 1);
+        auto const weight   = static_cast<std::uint32_t>(position & 0xFF);
+
+        auto const* row_a = image.pixels.data() + first * image.width;
+        auto const* row_b = image.pixels.data() + second * image.width;
+        for (std::size_t x = 0; x < width; ++x) {
+            auto const& tap = columns[x];
+            top[x]          = row_a[tap.first] * (256 - tap.weight) + row_a[tap.second] * tap.weight;
+            bottom[x]       = row_b[tap.first] * (256 - tap.weight) + row_b[tap.second] * tap.weight;
+        }
+
+        auto* out = scaled.pixels.data() + y * width;
+        for (std::size_t x = 0; x < width; ++x) {
+            out[x] = static_cast<std::uint8_t>((top[x] * (256 - weight) + bottom[x] * weight + 32768) >> 16);
+        }
+    }
+
+    return scaled;
+}
+
+RasterImage dither_floyd_steinberg(GrayImage const& image) {
+    auto raster          = make_raster(image.width, image.height);
+    auto const row_bytes = raster.bytes_per_row();
+
+    // Error carried into the current and the next row, padded by one
+    // entry on each side so the kernel never needs bounds checks
+    std::vector<std::int16_t> current(image.width + 2, 0);
+    std::vector<std::int16_t> next(image.width + 2, 0);
+
+    for (std::size_t y = 0; y < image.height; ++y) {
+        auto const* gray = image.pixels.data() + y * image.width;
+        auto* out        = raster.bits.data() + y * row_bytes;
+
+        for (std::size_t x = 0; x < image.width; ++x) {
+            int const value = gray[x] + current[x + 1];
+            int const shade = value < 128 ? 0 : 255;
+            int const error = value - shade;
+
+            if (shade == 0) {
+                out[x / 8] |= static_cast<std::uint8_t>(0x80 >> (x % 8));
+            }
+
+            current[x + 2] = static_cast<std::int16_t>(current[x + 2] + error * 7 / 16);
+            next[x]        = static_cast<std::int16_t>(next[x] + error * 3 / 16);
+            next[x + 1]    = static_cast<std::int16_t>(next[x + 1] + error * 5 / 16);
+            next[x + 2]    = static_cast<std::int16_t>(next[x + 2] + error / 16);
+        }
+
+        std::swap(current, next);
+        std::fill(begin(next), end(next), std::int16_t{0});
+    }
+
+    return raster;
+}
+
+RasterImage dither_ordered(GrayImage const& image, SimdLevel level) {
+    auto raster          = make_raster(image.width, image.height);
+    auto const row_bytes = raster.bytes_per_row();
+
+    level = std::min(level, best_simd_level());
+
+    for (std::size_t y = 0; y < image.height; ++y) {
+        auto const* gray   = image.pixels.data() + y * image.width;
+        auto const* limits = ORDERED_LIMITS[y % 8].data();
+        auto* out          = raster.bits.data() + y * row_bytes;
+
+        std::size_t done = 0;
+#ifdef FACHORY_RASTER_X86
+        if (level == SimdLevel::Avx2) {
+            done = dither_ordered_row_avx2(gray, image.width, limits, out);
+        } else if (level == SimdLevel::Sse) {
+            done = dither_ordered_row_sse(gray, image.width, limits, out);
+        }
+#endif
+        dither_ordered_row_scalar(gray, image.width, limits, done, out);
+    }
+
+    return raster;
+}
+
+std::optional<RasterImage> rasterize_jpeg(std::string const& path, RasterOptions const& options) {
+    auto const decoded = decode_jpeg_file(path, options.width);
+    if (!decoded) {
+        return std::nullopt;
+    }
+
+    auto const scaled = scale_to_width(*decoded, options.width);
+
+    switch (options.dither) {
+    case DitherMode::Ordered:
+        return dither_ordered(scaled);
+    case DitherMode::FloydSteinberg:
+        return dither_floyd_steinberg(scaled);
+    }
+
+    return std::nullopt;
+}
@@ -0,0 +1,287 @@
+#include <printer/simulated_backend.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iterator>
+#include <thread>
+#include <utility>
+
+namespace {
+
+    // Errors are per thread, like cupsLastErrorString
+    thread_local std::string last_simulated_error;
+
+    void set_error(std::string error) {
+        last_simulated_error = std::move(error);
+    }
+
+    std::chrono::nanoseconds transfer_time(std::size_t bytes, std::size_t bandwidth) {
+        auto const seconds = static_cast<double>(bytes) / static_cast<double>(bandwidth);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>{seconds});
+    }
+
+} // namespace
+
+struct SimulatedBackend::Printer final : PrinterHandle {
+    std::string name;
+    SimulatedPrinterOptions options;
+    std::atomic<bool> plugged_in;
+
+    std::atomic<std::uint64_t> jobs_created;
+    std::atomic<std::uint64_t> jobs_completed;
+    std::atomic<std::uint64_t> jobs_failed;
+    std::atomic<std::uint64_t> bytes_received;
+
+    std::mutex finished_mutex;
+    std::deque<FinishedJob> finished;
+
+    Printer(std::string name, SimulatedPrinterOptions options)
+        : name{std::move(name)}, options{options}, plugged_in{true}, jobs_created{0}, jobs_completed{0},
+          jobs_failed{0}, bytes_received{0}, finished{} {}
+
+    void finish(FinishedJob job) {
+        auto& counter = job.state == JobState::Completed ? jobs_completed : jobs_failed;
+        counter.fetch_add(1, std::memory_order_relaxed);
+
+        std::scoped_lock lock{finished_mutex};
+        finished.push_back(job);
+        if (finished.size() > FINISHED_JOB_HISTORY) {
+            finished.pop_front();
+        }
+    }
+};
+
+// Writes take as long as the printer's bandwidth says, and a job picked to
+// fail does so on its first write
+class SimulatedBackend::Job final : public BackendJob {
+public:
+    Job(std::shared_ptr<Printer> printer, int job_id, bool fails)
+        : _printer{std::move(printer)}, _job_id{job_id}, _fails{fails}, _failed{false}, _last{false},
+          _finished{false}, _cancelled{false}, _created{std::chrono::system_clock::now()}, _processing{},
+          _written_by{std::chrono::steady_clock::now()} {}
+
+    ~Job() override {
+        if (!_finished) {
+            finish_job();
+        }
+    }
+
+    Job(Job const&)            = delete;
+    Job& operator=(Job const&) = delete;
+
+    [[nodiscard]] int id() const override {
+        return _job_id;
+    }
+
+    [[nodiscard]] bool start_document(std::string const&, std::string const&, bool last) override {
+        _last = last;
+        if (!connected()) {
+            return false;
+        }
+
+        if (_processing == std::chrono::system_clock::time_point{}) {
+            _processing = std::chrono::system_clock::now();
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] bool write(std::span<char const> data) override {
+        if (!connected()) {
+            return false;
+        }
+
+        if (_fails) {
+            _failed = true;
+            set_error(fmt::format("simulated failure of job {} on printer {}", _job_id, _printer->name));
+            return false;
+        }
+
+        _printer->bytes_received.fetch_add(data.size(), std::memory_order_relaxed);
+
+        auto const bandwidth = _printer->options.bandwidth;
+        if (bandwidth != 0) {
+            // Sleeps off the whole backlog, so many small writes don't each
+            // pay for a wakeup they didn't need
+            auto const now = std::chrono::steady_clock::now();
+            _written_by    = std::max(_written_by, now) + transfer_time(data.size(), bandwidth);
+            std::this_thread::sleep_until(_written_by);
+        }
+
+        return true;
+    }
+
+    bool finish_document() override {
+        if (!connected()) {
+            return false;
+        }
+
+        // Like CUPS, the job is done once its last document is
+        if (_last) {
+            finish_job();
+        }
+
+        return true;
+    }
+
+    void cancel() override {
+        _cancelled = true;
+    }
+
+private:
+    std::shared_ptr<Printer> _printer;
+    int _job_id;
+    bool _fails;
+    bool _failed;
+    bool _last;
+    bool _finished;
+    bool _cancelled;
+    std::chrono::system_clock::time_point _created;
+    std::chrono::system_clock::time_point _processing;
+    std::chrono::steady_clock::time_point _written_by;
+
+    // Reports how the job ended to the printer, once
+    void finish_job() {
+        _finished = true;
+
+        auto state = JobState::Completed;
+        if (_failed || !_printer->plugged_in.load(std::memory_order_relaxed)) {
+            state = JobState::Aborted;
+        } else if (_cancelled) {
+            state = JobState::Canceled;
+        } else {
+            std::this_thread::sleep_for(_printer->options.job_latency);
+        }
+
+        _printer->finish(FinishedJob{.job_id = _job_id,
+         .state                              = state,
+         .created                            = _created,
+         .processing                         = _processing,
+         .completed                          = std::chrono::system_clock::now()});
+    }
+
+    [[nodiscard]] bool connected() const {
+        if (_printer->plugged_in.load(std::memory_order_relaxed)) {
+            return true;
+        }
+
+        set_error(fmt::format("printer {} was unplugged", _printer->name));
+        return false;
+    }
+};
+
+SimulatedBackend::SimulatedBackend(std::uint64_t seed) : _printers{}, _random{seed}, _next_job_id{0} {}
+
+SimulatedBackend::~SimulatedBackend() = default;
+
+void SimulatedBackend::plug_in(std::string const& name, SimulatedPrinterOptions options) {
+    auto printer = std::make_shared<Printer>(name, options);
+
+    std::scoped_lock lock{_mutex};
+    if (auto const found = _printers.find(name); found != end(_printers)) {
+        found->second->plugged_in.store(false, std::memory_order_relaxed);
+    }
+    _printers[name] = std::move(printer);
+}
+
+void SimulatedBackend::unplug(std::string const& name) {
+    // Kept around, so jobs it already finished can still be looked up
+    if (auto const printer = find(name)) {
+        printer->plugged_in.store(false, std::memory_order_relaxed);
+    }
+}
+
+std::optional<SimulatedPrinterStats> SimulatedBackend::stats(std::string const& name) const {
+    auto const printer = find(name);
+    if (!printer) {
+        return std::nullopt;
+    }
+
+    return SimulatedPrinterStats{.jobs_created = printer->jobs_created.load(std::memory_order_relaxed),
+     .jobs_completed                          = printer->jobs_completed.load(std::memory_order_relaxed),
+     .jobs_failed                             = printer->jobs_failed.load(std::memory_order_relaxed),
+     .bytes_received                          = printer->bytes_received.load(std::memory_order_relaxed)};
+}
+
+std::optional<std::vector<PrinterEntry>> SimulatedBackend::discover(
+    std::chrono::milliseconds, std::stop_token stop, PrinterSnapshot const& known) {
+    if (stop.stop_requested()) {
+        return std::nullopt;
+    }
+
+    std::scoped_lock lock{_mutex};
+
+    std::vector<PrinterEntry> printers;
+    printers.reserve(_printers.size());
+    for (auto const& [name, printer] : _printers) {
+        if (!printer->plugged_in.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        auto const* entry = known.find(name);
+        if (entry && entry->handle == printer) {
+            printers.push_back(*entry);
+            continue;
+        }
+
+        PrinterDetails details{.name = name, .instance = {}, .is_default = false, .options = {}};
+        printers.push_back(PrinterEntry{.details = std::move(details), .handle = printer});
+    }
+
+    return printers;
+}
+
+std::unique_ptr<BackendJob> SimulatedBackend::create_job(PrinterEntry const& printer, std::string const&) {
+    auto found = find(printer.details.name);
+    if (!found || !found->plugged_in.load(std::memory_order_relaxed)) {
+        set_error(fmt::format("printer {} is not plugged in", printer.details.name));
+        return nullptr;
+    }
+
+    int job_id = 0;
+    bool fails = false;
+    {
+        std::scoped_lock lock{_mutex};
+        job_id = ++_next_job_id;
+        if (found->options.failure_rate > 0.0) {
+            fails = std::bernoulli_distribution{found->options.failure_rate}(_random);
+        }
+    }
+
+    std::this_thread::sleep_for(found->options.job_latency);
+
+    found->jobs_created.fetch_add(1, std::memory_order_relaxed);
+    return std::make_unique<Job>(std::move(found), job_id, fails);
+}
+
+void SimulatedBackend::forget(std::string const&) {
+    // Nothing is kept outside of the printer itself
+}
+
+std::optional<std::vector<FinishedJob>> SimulatedBackend::finished_jobs(
+    std::string const& printer_name, int first_job_id) {
+    auto const printer = find(printer_name);
+    if (!printer) {
+        set_error(fmt::format("printer {} was never plugged in", printer_name));
+        return std::nullopt;
+    }
+
+    std::vector<FinishedJob> finished;
+    std::scoped_lock lock{printer->finished_mutex};
+    std::ranges::copy_if(printer->finished, std::back_inserter(finished),
+        [first_job_id](FinishedJob const& job) { return job.job_id >= first_job_id; });
+    return finished;
+}
+
+std::string SimulatedBackend::last_error() const {
+    return last_simulated_error;
+}
+
+std::shared_ptr<SimulatedBackend::Printer> SimulatedBackend::find(std::string const& name) const {
+    std::scoped_lock lock{_mutex};
+    auto const found = _printers.find(name);
+    return found == end(_printers) ? nullptr : found->second;
+}
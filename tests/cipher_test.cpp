@@ -0,0 +1,55 @@
+#include <database/cipher.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <string>
+
+namespace {
+
+    using fachory::db::CipherConfig;
+    using fachory::db::CipherSalt;
+    using fachory::db::derive_raw_key;
+    using fachory::db::is_raw_key;
+
+    constexpr char const* KEY_HEX  = "f1dbedd27b9bf994e77a761b2036013a9afffee39393117a94360af8902e1f7e";
+    constexpr char const* SALT_HEX = "000102030405060708090a0b0c0d0e0f";
+
+    CipherSalt counting_salt() {
+        CipherSalt salt;
+        for (std::size_t i = 0; i < salt.size(); ++i) {
+            salt[i] = static_cast<unsigned char>(i);
+        }
+
+        return salt;
+    }
+
+    TEST(CipherTest, DerivesSqlCipherRawKey) {
+        // PBKDF2-HMAC-SHA512 of "password" over SQLCipher 4's 256000 rounds,
+        // the salt appended after the key
+        auto const key = derive_raw_key("password", counting_salt(), CipherConfig{});
+        EXPECT_EQ(key, std::string{"x'"} + KEY_HEX + SALT_HEX + "'");
+        EXPECT_TRUE(is_raw_key(key));
+    }
+
+    TEST(CipherTest, AcceptsRawKeys) {
+        EXPECT_TRUE(is_raw_key(std::string{"x'"} + KEY_HEX + "'"));
+        EXPECT_TRUE(is_raw_key(std::string{"X'"} + KEY_HEX + SALT_HEX + "'"));
+    }
+
+    TEST(CipherTest, RejectsPassphrases) {
+        EXPECT_FALSE(is_raw_key(""));
+        EXPECT_FALSE(is_raw_key("password"));
+        EXPECT_FALSE(is_raw_key("x''"));
+
+        // Key and salt hex of the wrong length
+        EXPECT_FALSE(is_raw_key(std::string{"x'"} + KEY_HEX + "0'"));
+        EXPECT_FALSE(is_raw_key(std::string{"x'"} + std::string{KEY_HEX}.substr(2) + "'"));
+
+        // Not hex, or not quoted
+        EXPECT_FALSE(is_raw_key(std::string{"x'"} + std::string(64, 'g') + "'"));
+        EXPECT_FALSE(is_raw_key(std::string{"x'"} + KEY_HEX));
+        EXPECT_FALSE(is_raw_key(std::string{"y'"} + KEY_HEX + "'"));
+    }
+
+} // namespace
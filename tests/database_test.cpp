@@ -0,0 +1,225 @@
+#include <database/database.hpp>
+
+#include <SQLiteCpp/Database.h>
+#include <SQLiteCpp/Statement.h>
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    using fachory::db::ChangeKind;
+    using fachory::db::Database;
+    using fachory::db::DatabaseConfig;
+    using fachory::db::RowChange;
+
+    // What a subscriber saw, with the table copied out of the view
+    struct SeenChange {
+        std::string table;
+        ChangeKind kind;
+        std::int64_t row_id;
+    };
+
+    class DatabaseTest : public testing::Test {
+    protected:
+        std::filesystem::path _file;
+
+        void SetUp() override {
+            _file = std::filesystem::temp_directory_path()
+                / fmt::format("{}.db", testing::UnitTest::GetInstance()->current_test_info()->name());
+            remove_file();
+        }
+
+        void TearDown() override {
+            remove_file();
+        }
+
+        void remove_file() const {
+            for (auto const* suffix : {"", "-wal", "-shm"}) {
+                std::filesystem::remove(_file.string() + suffix);
+            }
+        }
+
+        // Creates the schema, then adds what the test needs on a connection
+        // of its own, the way another process would
+        void create(std::vector<std::string> const& statements) const {
+            Database{_file.string(), ""};
+
+            SQLite::Database db{_file.string(), SQLite::OPEN_READWRITE};
+            for (auto const& statement : statements) {
+                db.exec(statement);
+            }
+        }
+
+        [[nodiscard]] std::int64_t add_task(std::string const& uuid, std::string const& name) const {
+            SQLite::Database db{_file.string(), SQLite::OPEN_READWRITE};
+            SQLite::Statement insert{db, "INSERT INTO pending (uuid, name) VALUES (?, ?)"};
+            insert.bind(1, uuid);
+            insert.bind(2, name);
+            insert.exec();
+            return db.getLastInsertRowid();
+        }
+
+        [[nodiscard]] std::int64_t count(std::string const& sql) const {
+            SQLite::Database db{_file.string(), SQLite::OPEN_READONLY};
+            SQLite::Statement query{db, sql};
+            query.executeStep();
+            return query.getColumn(0).getInt64();
+        }
+    };
+
+    // Fails the delete that moves a task named poison out of pending, after
+    // its copy was inserted into completed
+    constexpr char const* POISON_TRIGGER = R"(CREATE TRIGGER poison AFTER DELETE ON pending WHEN old.name = 'poison'
+        BEGIN SELECT RAISE(ABORT, 'poisoned'); END;)";
+
+    TEST_F(DatabaseTest, FailingWriteIsUndoneWithoutItsGroup) {
+        create({POISON_TRIGGER});
+        auto const blocker  = add_task("blocker", "blocker");
+        auto const poisoned = add_task("poisoned", "poison");
+        std::vector<std::string> healthy;
+        for (int i = 0; i < 4; ++i) {
+            healthy.push_back(fmt::format("healthy-{}", i));
+            std::ignore = add_task(healthy.back(), "healthy");
+        }
+
+        Database database{_file.string(), "", DatabaseConfig{.concurrent = true, .readers = 1}};
+
+        std::mutex seen_mutex;
+        std::vector<SeenChange> seen;
+        std::promise<void> writer_busy;
+        bool first = true;
+        auto const subscription = database.subscribe([&](std::span<RowChange const> changes) {
+            {
+                std::scoped_lock lock{seen_mutex};
+                for (auto const& change : changes) {
+                    seen.push_back(
+                        SeenChange{.table = std::string{change.table}, .kind = change.kind, .row_id = change.row_id});
+                }
+            }
+
+            // Holds the writer thread after the first commit, so the writes
+            // queued meanwhile are committed as one group
+            if (std::exchange(first, false)) {
+                writer_busy.set_value();
+                std::this_thread::sleep_for(std::chrono::milliseconds{200});
+            }
+        });
+
+        auto blocked = std::async(std::launch::async, [&] { return database.mark_task_done("blocker"); });
+        writer_busy.get_future().wait();
+
+        std::vector<std::future<std::size_t>> results;
+        results.push_back(std::async(std::launch::async, [&] {
+            return database.mark_tasks_done(std::span{&std::as_const(healthy[0]), 2});
+        }));
+        results.push_back(std::async(std::launch::async, [&] {
+            std::string const uuid = "poisoned";
+            return database.mark_tasks_done(std::span{&uuid, 1});
+        }));
+        results.push_back(std::async(std::launch::async, [&] {
+            return database.mark_tasks_done(std::span{&std::as_const(healthy[2]), 2});
+        }));
+
+        EXPECT_TRUE(blocked.get());
+        EXPECT_EQ(results[0].get(), 2);
+        EXPECT_EQ(results[1].get(), 0);
+        EXPECT_EQ(results[2].get(), 2);
+        database.unsubscribe(subscription);
+
+        EXPECT_EQ(count("SELECT COUNT(*) FROM pending"), 1);
+        EXPECT_EQ(count("SELECT COUNT(*) FROM completed"), 5);
+        EXPECT_EQ(count("SELECT COUNT(*) FROM completed WHERE uuid = 'poisoned'"), 0);
+
+        // The rolled back write's staged changes were dropped with it
+        EXPECT_EQ(std::ranges::count(seen, std::string{"completed"}, &SeenChange::table), 5);
+        EXPECT_EQ(std::ranges::count_if(
+                      seen, [&](auto const& change) { return change.table == "pending" && change.row_id == poisoned; }),
+            0);
+        EXPECT_EQ(std::ranges::count_if(
+                      seen, [&](auto const& change) { return change.table == "pending" && change.row_id == blocker; }),
+            1);
+    }
+
+    TEST_F(DatabaseTest, RowInsertedAndDeletedInOneCommitIsNotReported) {
+        // A completed task named transient deletes itself straight away
+        create({R"(CREATE TRIGGER transient AFTER INSERT ON completed WHEN new.name = 'transient'
+                   BEGIN DELETE FROM completed WHERE id = new.id; END;)"});
+        auto const row_id = add_task("transient", "transient");
+
+        Database database{_file.string(), ""};
+
+        std::vector<SeenChange> seen;
+        std::ignore = database.subscribe([&](std::span<RowChange const> changes) {
+            for (auto const& change : changes) {
+                seen.push_back(
+                    SeenChange{.table = std::string{change.table}, .kind = change.kind, .row_id = change.row_id});
+            }
+        });
+
+        EXPECT_TRUE(database.mark_task_done("transient"));
+
+        ASSERT_EQ(seen.size(), 1);
+        EXPECT_EQ(seen[0].table, "pending");
+        EXPECT_EQ(seen[0].kind, ChangeKind::Deleted);
+        EXPECT_EQ(seen[0].row_id, row_id);
+    }
+
+    TEST_F(DatabaseTest, MatchingFingerprintSkipsMigrations) {
+        create({});
+        auto const migrations = count("SELECT COUNT(*) FROM migrations");
+
+        // Migrating would record the forgotten migration again
+        {
+            SQLite::Database db{_file.string(), SQLite::OPEN_READWRITE};
+            db.exec("DELETE FROM migrations WHERE rowid = (SELECT MAX(rowid) FROM migrations)");
+        }
+
+        { Database database{_file.string(), ""}; }
+        EXPECT_EQ(count("SELECT COUNT(*) FROM migrations"), migrations - 1);
+
+        {
+            SQLite::Database db{_file.string(), SQLite::OPEN_READWRITE};
+            db.exec("UPDATE schema_meta SET value = 'stale' WHERE key = 'fingerprint'");
+        }
+
+        { Database database{_file.string(), ""}; }
+        EXPECT_EQ(count("SELECT COUNT(*) FROM migrations"), migrations);
+    }
+
+    TEST_F(DatabaseTest, CipherSettingsAreRecordedWithTheSchema) {
+        create({});
+        EXPECT_EQ(count("SELECT value FROM schema_meta WHERE key = 'cipher_kdf_iter'"), 256'000);
+
+        auto const fingerprint = [this] {
+            SQLite::Database db{_file.string(), SQLite::OPEN_READONLY};
+            SQLite::Statement query{db, "SELECT value FROM schema_meta WHERE key = 'fingerprint'"};
+            query.executeStep();
+            return query.getColumn(0).getString();
+        };
+        auto const created_with = fingerprint();
+
+        // Other settings are checked, and noted in the fingerprint, but what
+        // the file was created with stays recorded
+        { Database database{_file.string(), "", DatabaseConfig{.cipher = {.kdf_iter = 64'000}}}; }
+        EXPECT_EQ(count("SELECT value FROM schema_meta WHERE key = 'cipher_kdf_iter'"), 256'000);
+        EXPECT_NE(fingerprint(), created_with);
+
+        { Database database{_file.string(), ""}; }
+        EXPECT_EQ(fingerprint(), created_with);
+    }
+
+} // namespace
@@ -0,0 +1,45 @@
+#include <printer/job_monitor.hpp>
+#include <printer/printer_manager.hpp>
+#include <printer/simulated_backend.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+
+namespace {
+
+    constexpr char const* TEST_PRINTER = "test";
+
+    TEST(JobMonitorTest, PrintedJobIsReportedCompleted) {
+        auto backend = std::make_shared<SimulatedBackend>();
+        backend->plug_in(TEST_PRINTER);
+
+        PrinterManager manager{PrinterManagerConfig{
+            .backend           = std::move(backend),
+            .job_poll_interval = std::chrono::milliseconds{10},
+        }};
+        ASSERT_TRUE(manager.wait_for_printers(std::chrono::seconds{1}));
+
+        auto const result = manager.submit(TEST_PRINTER, PrintPayload::text("[ ] task\n")).get();
+        ASSERT_TRUE(result.success);
+
+        auto completion = manager.track_job(result);
+        ASSERT_EQ(completion.wait_for(std::chrono::seconds{5}), std::future_status::ready);
+        EXPECT_EQ(completion.get().state, JobState::Completed);
+    }
+
+    TEST(JobMonitorTest, JobNeverReportedIsGivenUpOn) {
+        SimulatedBackend backend;
+        backend.plug_in(TEST_PRINTER);
+
+        JobMonitor monitor{backend, std::chrono::milliseconds{10}, std::chrono::milliseconds{50}};
+        auto completion = monitor.watch(TEST_PRINTER, 12345);
+
+        ASSERT_EQ(completion.wait_for(std::chrono::seconds{5}), std::future_status::ready);
+        EXPECT_EQ(completion.get().state, JobState::Unknown);
+        EXPECT_EQ(monitor.in_flight(), 0);
+    }
+
+} // namespace
@@ -0,0 +1,66 @@
+#include <printer/payload_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+    constexpr std::size_t PAYLOAD_BYTES = 1000;
+
+    class PayloadCacheTest : public testing::Test {
+    protected:
+        std::filesystem::path _directory;
+
+        void SetUp() override {
+            _directory = std::filesystem::temp_directory_path()
+                / testing::UnitTest::GetInstance()->current_test_info()->name();
+            std::filesystem::remove_all(_directory);
+        }
+
+        void TearDown() override {
+            std::filesystem::remove_all(_directory);
+        }
+
+        [[nodiscard]] std::size_t spilled_bytes() const {
+            std::size_t bytes = 0;
+            for (auto const& item : std::filesystem::directory_iterator{_directory}) {
+                bytes += item.file_size();
+            }
+
+            return bytes;
+        }
+    };
+
+    TEST_F(PayloadCacheTest, SpillDirectoryStaysWithinItsBudget) {
+        // Room for four payloads in memory and three on disk
+        PayloadCache cache{4 * PAYLOAD_BYTES, _directory, 3 * PAYLOAD_BYTES};
+        for (PayloadKey key = 0; key < 20; ++key) {
+            cache.insert(key, std::vector<std::byte>(PAYLOAD_BYTES));
+        }
+
+        EXPECT_EQ(spilled_bytes(), 3 * PAYLOAD_BYTES);
+
+        // The newest spilled payloads are the ones kept
+        EXPECT_NE(cache.find(15), nullptr);
+        EXPECT_EQ(cache.find(0), nullptr);
+    }
+
+    TEST_F(PayloadCacheTest, LeftoversFromAnEarlierRunAreTrimmed) {
+        {
+            PayloadCache cache{4 * PAYLOAD_BYTES, _directory, 10 * PAYLOAD_BYTES};
+            for (PayloadKey key = 0; key < 10; ++key) {
+                cache.insert(key, std::vector<std::byte>(PAYLOAD_BYTES));
+            }
+        }
+
+        std::ofstream{_directory / "0000000000000001.bin.42.tmp"} << "partial";
+
+        PayloadCache cache{4 * PAYLOAD_BYTES, _directory, 2 * PAYLOAD_BYTES};
+        EXPECT_EQ(spilled_bytes(), 2 * PAYLOAD_BYTES);
+    }
+
+} // namespace
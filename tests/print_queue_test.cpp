@@ -0,0 +1,70 @@
+#include <printer/printer_manager.hpp>
+#include <printer/simulated_backend.hpp>
+
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace {
+
+    constexpr char const* TEST_PRINTER = "test";
+    constexpr std::size_t RECEIPTS     = 50;
+
+    // Submits RECEIPTS small texts in a burst and waits for all of them,
+    // returning how many jobs the manager created for them
+    std::uint64_t print_burst(CoalescingOptions coalescing) {
+        auto backend = std::make_shared<SimulatedBackend>();
+        backend->plug_in(TEST_PRINTER);
+
+        PrinterManager manager{PrinterManagerConfig{.backend = std::move(backend), .coalescing = coalescing}};
+        EXPECT_TRUE(manager.wait_for_printers(std::chrono::seconds{1}));
+
+        std::vector<std::future<JobResult>> results;
+        results.reserve(RECEIPTS);
+        for (std::size_t i = 0; i < RECEIPTS; ++i) {
+            results.push_back(manager.submit(TEST_PRINTER, PrintPayload::text(fmt::format("[ ] task {}\n", i))));
+        }
+
+        for (auto& result : results) {
+            EXPECT_TRUE(result.get().success);
+        }
+
+        return manager.jobs_created();
+    }
+
+    TEST(PrintQueueTest, EveryPayloadIsOneJobWithoutCoalescing) {
+        EXPECT_EQ(print_burst(CoalescingOptions{.enabled = false}), RECEIPTS);
+    }
+
+    TEST(PrintQueueTest, BurstIsCoalescedIntoOneJob) {
+        // The burst is queued well within one window, so every payload joins
+        // the batch started by the first one
+        auto const jobs = print_burst(CoalescingOptions{
+            .enabled   = true,
+            .window    = std::chrono::milliseconds{200},
+            .max_delay = std::chrono::seconds{2},
+        });
+
+        EXPECT_EQ(jobs, 1);
+    }
+
+    TEST(PrintQueueTest, UnknownPrinterFailsWithoutAJob) {
+        auto backend = std::make_shared<SimulatedBackend>();
+        backend->plug_in(TEST_PRINTER);
+
+        PrinterManager manager{PrinterManagerConfig{.backend = std::move(backend)}};
+        EXPECT_TRUE(manager.wait_for_printers(std::chrono::seconds{1}));
+
+        auto const result = manager.submit("missing", PrintPayload::text("[ ] task\n")).get();
+        EXPECT_FALSE(result.success);
+        EXPECT_EQ(result.error, "printer missing is not registered");
+        EXPECT_EQ(manager.jobs_created(), 0);
+    }
+
+} // namespace
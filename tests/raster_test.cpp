@@ -0,0 +1,47 @@
+#include <printer/raster.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace {
+
+    GrayImage random_image(std::size_t width, std::size_t height, std::uint32_t seed) {
+        std::mt19937 engine{seed};
+        std::uniform_int_distribution<int> gray{0, 255};
+
+        GrayImage image{.width = width, .height = height, .pixels = std::vector<std::uint8_t>(width * height)};
+        for (auto& pixel : image.pixels) {
+            pixel = static_cast<std::uint8_t>(gray(engine));
+        }
+
+        return image;
+    }
+
+    // Runs the case with every SIMD level this CPU supports
+    class DitherOrderedTest : public testing::TestWithParam<std::size_t> {};
+
+    TEST_P(DitherOrderedTest, SimdMatchesScalar) {
+        auto const width  = GetParam();
+        auto const image  = random_image(width, 37, static_cast<std::uint32_t>(width));
+        auto const scalar = dither_ordered(image, SimdLevel::Scalar);
+
+        for (auto const level : {SimdLevel::Sse, SimdLevel::Avx2}) {
+            if (level > best_simd_level()) {
+                continue;
+            }
+
+            auto const simd = dither_ordered(image, level);
+            EXPECT_EQ(simd.width, scalar.width);
+            EXPECT_EQ(simd.height, scalar.height);
+            EXPECT_EQ(simd.bits, scalar.bits) << "level " << static_cast<int>(level);
+        }
+    }
+
+    // Widths around the 16 and 32 pixel blocks so the scalar tails run too
+    INSTANTIATE_TEST_SUITE_P(Widths, DitherOrderedTest,
+        testing::Values(1, 7, 8, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 100, 384, 577));
+
+} // namespace